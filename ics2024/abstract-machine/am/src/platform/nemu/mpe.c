@@ -1,18 +1,44 @@
 #include <am.h>
+#include <nemu.h>
 #include <stdatomic.h>
 #include <klib-macros.h>
 
-bool mpe_init(void (*entry)()) {
-  entry();
+#define MAX_CPU    8
+#define STACK_SIZE 0x8000
+
+#define MPE_NR_CPU (MPE_ADDR + 0x00)
+#define MPE_CPU_ID (MPE_ADDR + 0x04)
+#define MPE_ENTRY  (MPE_ADDR + 0x08)
+#define MPE_STACK  (MPE_ADDR + 0x0c)
+#define MPE_START  (MPE_ADDR + 0x10)
+
+// CPU 0 runs on the stack given by the linker script
+static uint8_t mpe_stack[MAX_CPU][STACK_SIZE] __attribute__((aligned(16)));
+static void (*mpe_entry)() = NULL;
+
+static void mpe_start() {
+  mpe_entry();
   panic("MPE entry returns");
 }
 
+bool mpe_init(void (*entry)()) {
+  mpe_entry = entry;
+  for (int i = 1; i < cpu_count(); i ++) {
+    outl(MPE_ENTRY, (uintptr_t)mpe_start);
+    outl(MPE_STACK, (uintptr_t)&mpe_stack[i][STACK_SIZE]);
+    outl(MPE_START, i);
+  }
+  mpe_start();
+  return false;
+}
+
 int cpu_count() {
-  return 1;
+  int n = inl(MPE_NR_CPU);
+  return (n < MAX_CPU ? n : MAX_CPU);
 }
 
 int cpu_current() {
-  return 0;
+  return inl(MPE_CPU_ID);
 }
 
 int atomic_xchg(int *addr, int newval) {
@@ -1,7 +1,9 @@
 include $(AM_HOME)/scripts/isa/riscv.mk
 include $(AM_HOME)/scripts/platform/nemu.mk
 CFLAGS  += -DISA_H=\"riscv/riscv.h\"
-COMMON_CFLAGS += -march=rv32im_zicsr -mabi=ilp32   # overwrite
+# the A extension is only executed by NEMU configured with CONFIG_RV_A
+RV_A          ?= $(if $(shell grep -s '^CONFIG_RV_A=y' $(NEMU_HOME)/.config),a)
+COMMON_CFLAGS += -march=rv32im$(RV_A)_zicsr -mabi=ilp32   # overwrite
 LDFLAGS       += -melf32lriscv                     # overwrite
 
 AM_SRCS += riscv/nemu/start.S \
@@ -19,6 +19,17 @@
 #include <common.h>
 
 void cpu_exec(uint64_t n);
+// run without tracing, profiling or difftest, e.g. when fast-forwarding
+void cpu_set_fast_forward(bool on);
+
+#ifdef CONFIG_MULTI_HART
+// the hart running on the calling host thread
+int hart_id();
+// start hart `id' at `pc' with `sp' as its stack pointer
+void hart_start(int id, vaddr_t pc, word_t sp);
+// instructions retired by the calling hart
+uint64_t hart_instret();
+#endif
 
 void set_nemu_state(int state, vaddr_t pc, int halt_ret);
 void invalid_inst(vaddr_t thispc);
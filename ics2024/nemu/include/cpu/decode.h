@@ -23,9 +23,13 @@ typedef struct Decode {
   vaddr_t snpc; // static next pc
   vaddr_t dnpc; // dynamic next pc
   ISADecodeInfo isa;
-  IFDEF(CONFIG_ITRACE, char logbuf[128]);
 } Decode;
 
+// invalidate the cached decoding results of the page containing `addr`
+void decode_cache_invalidate(paddr_t addr);
+// drop the cached blocks when code is written
+void block_cache_invalidate(paddr_t addr);
+
 // --- pattern matching mechanism ---
 __attribute__((always_inline))
 static inline void pattern_decode(const char *str, int len,
@@ -86,7 +90,56 @@ finish:
 }
 
 
+#ifdef CONFIG_INST_MIX
+// counters of the patterns, indexed by the line of INSTPAT() in inst.c
+typedef struct {
+  const char *name;
+  uint64_t count;
+} InstPatCounter;
+
+#define INSTPAT_COUNTER_MAX 4096
+extern InstPatCounter instpat_counter[INSTPAT_COUNTER_MAX];
+
+#define INSTPAT_COUNT(pat) do { \
+  static_assert(__LINE__ < INSTPAT_COUNTER_MAX, "too many lines for the pattern counters"); \
+  instpat_counter[__LINE__].name = str(pat); \
+  instpat_counter[__LINE__].count ++; \
+} while (0)
+
+// count the accesses to memory by instructions, but not those by the debugger
+#define INST_LOAD(n)  (imix_nr_load += (n))
+#define INST_STORE(n) (imix_nr_store += (n))
+#else
+#define INSTPAT_COUNT(pat)
+#define INST_LOAD(n)  ((void)0)
+#define INST_STORE(n) ((void)0)
+#endif
+
 // --- pattern matching wrappers for decode ---
+#ifdef CONFIG_DECODE_CACHE
+/* A hit in the decode cache jumps to the execution body recorded by
+ * INSTPAT_HANDLER(), after the end label of the patterns is set up.
+ */
+#define INSTPAT_DISPATCH(s) if ((s)->isa.handler != NULL) goto *(s)->isa.handler;
+#else
+#define INSTPAT_DISPATCH(s)
+#endif
+
+#ifdef CONFIG_INSTPAT_TREE
+/* The decode tree instpat_tree_L() for the INSTPAT_START() at line L is
+ * generated by tools/gen-decode, and returns the line of the first matching
+ * pattern. Each pattern then becomes a case label of its line number.
+ */
+#define INSTPAT(pattern, ...) case __LINE__: { \
+  INSTPAT_MATCH(s, ##__VA_ARGS__); \
+  goto *(__instpat_end); \
+}
+
+#define INSTPAT_START(name) { const void * __instpat_end = &&concat(__instpat_end_, name); \
+  INSTPAT_DISPATCH(s) \
+  switch (concat(instpat_tree_, __LINE__)(INSTPAT_INST(s))) {
+#define INSTPAT_END(name)   } concat(__instpat_end_, name): ; }
+#else
 #define INSTPAT(pattern, ...) do { \
   uint64_t key, mask, shift; \
   pattern_decode(pattern, STRLEN(pattern), &key, &mask, &shift); \
@@ -96,7 +149,9 @@ finish:
   } \
 } while (0)
 
-#define INSTPAT_START(name) { const void * __instpat_end = &&concat(__instpat_end_, name);
+#define INSTPAT_START(name) { const void * __instpat_end = &&concat(__instpat_end_, name); \
+  INSTPAT_DISPATCH(s)
 #define INSTPAT_END(name)   concat(__instpat_end_, name): ; }
+#endif
 
 #endif
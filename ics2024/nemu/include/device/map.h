@@ -28,6 +28,7 @@ typedef struct {
   paddr_t high;
   void *space;
   io_callback_t callback;
+  uint64_t nr_read, nr_write;
 } IOMap;
 
 static inline bool map_inside(IOMap *map, paddr_t addr) {
@@ -38,19 +39,67 @@ static inline int find_mapid_by_addr(IOMap *maps, int size, paddr_t addr) {
   int i;
   for (i = 0; i < size; i ++) {
     if (map_inside(maps + i, addr)) {
-      difftest_skip_ref();
       return i;
     }
   }
   return -1;
 }
 
+/* A two-level table from the granules of an address space to the map
+ * covering them, so that most accesses find their map without a scan.
+ * A granule covered by several maps (e.g. the page holding the registers
+ * of many devices) falls back to the scan, as well as the addresses beyond
+ * the table.
+ */
+#define MAP_TABLE_BITS 10
+#define MAP_TABLE_NONE 0
+#define MAP_TABLE_SHARED 0xff
+
+typedef struct {
+  int shift; // log2 of the size of a granule
+  IOMap *maps;
+  int nr_map;
+  // the map found last, any map is valid here so racing harts only cost a scan,
+  // accessed with relaxed atomics since harts may run on different threads
+  IOMap *last;
+  // mapid + 1 of every granule, or one of MAP_TABLE_{NONE,SHARED}
+  uint8_t *dir[1 << MAP_TABLE_BITS];
+} IOMapTable;
+
+void map_table_add(IOMapTable *t, IOMap *map);
+
+static inline IOMap* map_table_find(IOMapTable *t, paddr_t addr) {
+  IOMap *map = __atomic_load_n(&t->last, __ATOMIC_RELAXED);
+  if (map != NULL && map_inside(map, addr)) return map;
+  uint64_t idx = (uint64_t)addr >> t->shift;
+  int e = MAP_TABLE_SHARED;
+  if (idx >> (2 * MAP_TABLE_BITS) == 0) {
+    uint8_t *sub = t->dir[idx >> MAP_TABLE_BITS];
+    e = (sub == NULL ? MAP_TABLE_NONE : sub[idx & ((1 << MAP_TABLE_BITS) - 1)]);
+  }
+  if (e == MAP_TABLE_NONE) return NULL;
+  if (e == MAP_TABLE_SHARED) {
+    int mapid = find_mapid_by_addr(t->maps, t->nr_map, addr);
+    if (mapid == -1) return NULL;
+    e = mapid + 1;
+  }
+  map = &t->maps[e - 1];
+  __atomic_store_n(&t->last, map, __ATOMIC_RELAXED);
+  return map;
+}
+
 void add_pio_map(const char *name, ioaddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
 void add_mmio_map(const char *name, paddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
+// add a map accessed as plain RAM, return the dirty bytes of its granules
+// if `dirty_shift' is not negative, or NULL otherwise
+uint8_t* add_mmio_ram(const char *name, paddr_t addr,
+        void *space, uint32_t len, int dirty_shift);
 
 word_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, int len, word_t data, IOMap *map);
+// write the access counts of the maps as a JSON array
+void map_dump_stats(FILE *fp, IOMap *maps, int nr_map);
 
 #endif
@@ -17,8 +17,56 @@
 #define __DEVICE_MMIO_H__
 
 #include <common.h>
+#include <memory/host.h>
+#include <device/map.h>
 
 word_t mmio_read(paddr_t addr, int len);
 void mmio_write(paddr_t addr, int len, word_t data);
 
+/* Regions of devices without side effects, e.g. frame buffers, which
+ * paddr_read() and paddr_write() access as plain RAM instead of going
+ * through map_read() and map_write(). A write may mark the granules it
+ * touches as dirty for the device.
+ */
+typedef struct {
+  paddr_t low;
+  uint32_t size;
+  uint8_t *space;
+  uint8_t *dirty; // one byte per granule of (1 << dirty_shift) bytes, or NULL
+  int dirty_shift;
+  IOMap *map;     // for the access counts
+} MMIORam;
+
+#define NR_MMIO_RAM 4
+extern MMIORam mmio_ram[];
+extern int nr_mmio_ram;
+
+// mark everything dirty, after the regions are changed behind the devices
+void mmio_ram_mark_dirty();
+
+static inline MMIORam* mmio_ram_find(paddr_t addr, int len) {
+  for (int i = 0; i < nr_mmio_ram; i ++) {
+    MMIORam *r = &mmio_ram[i];
+    if (addr - r->low <= r->size - len) return r;
+  }
+  return NULL;
+}
+
+static inline word_t mmio_ram_read(MMIORam *r, paddr_t addr, int len) {
+  difftest_skip_ref();
+  r->map->nr_read ++;
+  return host_read(r->space + (addr - r->low), len);
+}
+
+static inline void mmio_ram_write(MMIORam *r, paddr_t addr, int len, word_t data) {
+  paddr_t offset = addr - r->low;
+  difftest_skip_ref();
+  r->map->nr_write ++;
+  host_write(r->space + offset, len, data);
+  if (r->dirty != NULL) {
+    r->dirty[offset >> r->dirty_shift] = 1;
+    r->dirty[(offset + len - 1) >> r->dirty_shift] = 1;
+  }
+}
+
 #endif
@@ -29,13 +29,34 @@ extern unsigned char isa_logo[];
 void init_isa();
 
 // reg
+#ifdef CONFIG_MULTI_HART
+// every hart has its own state, `cpu' is the one of the calling host thread
+extern CPU_state harts[CONFIG_NR_HART];
+extern __thread CPU_state *hart_cpu;
+#define cpu (*hart_cpu)
+// initialize the state of a hart started by the calling one
+void isa_hart_init(CPU_state *hart, vaddr_t pc, word_t sp);
+#else
 extern CPU_state cpu;
+#endif
 void isa_reg_display();
 word_t isa_reg_str2val(const char *name, bool *success);
 
 // exec
 struct Decode;
 int isa_exec_once(struct Decode *s);
+// execute an instruction which is already decoded by isa_exec_once()
+int isa_exec_decoded(struct Decode *s);
+// decode the instruction at s->pc without executing it
+int isa_decode(struct Decode *s);
+// decode `inst' as the instruction at s->pc without executing it
+int isa_decode_inst(struct Decode *s, uint32_t inst);
+// run at most `n' instructions from cpu.pc with threaded code, return the number executed
+uint64_t isa_exec_threaded(uint64_t n);
+
+// classify the control transfer by the instruction executed in `s'
+enum { JUMP_NONE, JUMP_CALL, JUMP_RET };
+int isa_jump_kind(struct Decode *s);
 
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
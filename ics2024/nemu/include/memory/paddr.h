@@ -22,6 +22,16 @@
 #define PMEM_RIGHT ((paddr_t)CONFIG_MBASE + CONFIG_MSIZE - 1)
 #define RESET_VECTOR (PMEM_LEFT + CONFIG_PC_RESET_OFFSET)
 
+#define PAGE_SHIFT        12
+#define PAGE_SIZE         (1ul << PAGE_SHIFT)
+#define PAGE_MASK         (PAGE_SIZE - 1)
+
+#if   defined(CONFIG_PMEM_MALLOC) || defined(CONFIG_PMEM_SPARSE)
+extern uint8_t *pmem;
+#else // CONFIG_PMEM_GARRAY
+extern uint8_t pmem[];
+#endif
+
 /* convert the guest physical address in the guest program to host virtual address in NEMU */
 uint8_t* guest_to_host(paddr_t paddr);
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
@@ -31,7 +41,94 @@ static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
+/* clear [addr, addr + len) to zero, with pages not touched any more
+ * given back to the host if possible */
+void pmem_clear(paddr_t addr, size_t len);
+/* give [addr, addr + len) random contents as at the start-up, which are
+ * not initialized until the first access with CONFIG_MEM_RANDOM_LAZY */
+void pmem_randomize(paddr_t addr, size_t len);
+
+#ifdef CONFIG_MEM_RANDOM_LAZY
+/* Make [addr, addr + len) accessible without initializing it, before it
+ * is fully written, e.g. by read(), which fails on inaccessible pages.
+ */
+void pmem_prepare_write(paddr_t addr, size_t len);
+/* whether the page at `addr' has been accessed, or made accessible, since
+ * it is inaccessible; reading an inaccessible page initializes it */
+bool pmem_page_touched(paddr_t addr);
+#endif
+
+#ifdef CONFIG_DECODE_CACHE
+/* writes to a watched page invalidate the decode cache */
+void pmem_watch_code(paddr_t addr);
+
+extern bool pmem_code_page[];
+void pmem_code_written(paddr_t addr);
+
+static inline void pmem_check_code(paddr_t addr, int len) {
+  paddr_t off = addr - CONFIG_MBASE;
+  if (unlikely(pmem_code_page[off >> PAGE_SHIFT])) pmem_code_written(addr);
+  if (unlikely(pmem_code_page[(off + len - 1) >> PAGE_SHIFT])) pmem_code_written(addr + len - 1);
+}
+#endif
+
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
 
+/* atomic memory operations, only for pmem */
+enum { AMO_SWAP, AMO_ADD, AMO_XOR, AMO_AND, AMO_OR, AMO_MIN, AMO_MAX, AMO_MINU, AMO_MAXU };
+// apply `op' to the memory at `addr' with `src' atomically, return the old value
+word_t paddr_amo(paddr_t addr, int len, int op, word_t src);
+// write `data' to `addr' only if it still holds `expected', return whether it is written
+bool paddr_cas(paddr_t addr, int len, word_t expected, word_t data);
+
+// accesses outside pmem, i.e. MMIO or out of bound
+word_t paddr_read_slow(paddr_t addr, int len);
+void paddr_write_slow(paddr_t addr, int len, word_t data);
+
+/* Accessors specialised by width. An access inside pmem is a bounds check
+ * plus a single load or store, everything else takes the slow path.
+ */
+#define def_paddr_access(len, type) \
+static inline word_t concat(paddr_read_, len)(paddr_t addr) { \
+  if (likely(addr - CONFIG_MBASE <= CONFIG_MSIZE - len)) { \
+    return *(type *)(pmem + (addr - CONFIG_MBASE)); \
+  } \
+  return paddr_read_slow(addr, len); \
+} \
+static inline void concat(paddr_write_, len)(paddr_t addr, word_t data) { \
+  if (likely(addr - CONFIG_MBASE <= CONFIG_MSIZE - len)) { \
+    *(type *)(pmem + (addr - CONFIG_MBASE)) = data; \
+    IFDEF(CONFIG_DECODE_CACHE, pmem_check_code(addr, len)); \
+    return; \
+  } \
+  paddr_write_slow(addr, len, data); \
+}
+
+def_paddr_access(1, uint8_t)
+def_paddr_access(2, uint16_t)
+def_paddr_access(4, uint32_t)
+IFDEF(CONFIG_ISA64, def_paddr_access(8, uint64_t))
+
+// `len' is a constant at most call sites, so the switch is folded away
+static inline word_t paddr_read_fast(paddr_t addr, int len) {
+  switch (len) {
+    case 1: return paddr_read_1(addr);
+    case 2: return paddr_read_2(addr);
+    case 4: return paddr_read_4(addr);
+    IFDEF(CONFIG_ISA64, case 8: return paddr_read_8(addr));
+    default: return paddr_read(addr, len);
+  }
+}
+
+static inline void paddr_write_fast(paddr_t addr, int len, word_t data) {
+  switch (len) {
+    case 1: paddr_write_1(addr, data); return;
+    case 2: paddr_write_2(addr, data); return;
+    case 4: paddr_write_4(addr, data); return;
+    IFDEF(CONFIG_ISA64, case 8: paddr_write_8(addr, data); return);
+    default: paddr_write(addr, len, data);
+  }
+}
+
 #endif
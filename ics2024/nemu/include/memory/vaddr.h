@@ -16,14 +16,29 @@
 #ifndef __MEMORY_VADDR_H__
 #define __MEMORY_VADDR_H__
 
-#include <common.h>
+#include <isa.h>
+#include <memory/paddr.h>
 
-word_t vaddr_ifetch(vaddr_t addr, int len);
-word_t vaddr_read(vaddr_t addr, int len);
-void vaddr_write(vaddr_t addr, int len, word_t data);
+// accesses which go through the MMU, and the atomic ones
+word_t vaddr_mmu_read(vaddr_t addr, int len, int type);
+void vaddr_mmu_write(vaddr_t addr, int len, word_t data);
+word_t vaddr_amo(vaddr_t addr, int len, int op, word_t src);
+bool vaddr_cas(vaddr_t addr, int len, word_t expected, word_t data);
 
-#define PAGE_SHIFT        12
-#define PAGE_SIZE         (1ul << PAGE_SHIFT)
-#define PAGE_MASK         (PAGE_SIZE - 1)
+// An access which needs no translation goes to the paddr accessors inline.
+static inline word_t vaddr_ifetch(vaddr_t addr, int len) {
+  if (likely(isa_mmu_check(addr, len, MEM_TYPE_IFETCH) == MMU_DIRECT)) return paddr_read_fast(addr, len);
+  return vaddr_mmu_read(addr, len, MEM_TYPE_IFETCH);
+}
+
+static inline word_t vaddr_read(vaddr_t addr, int len) {
+  if (likely(isa_mmu_check(addr, len, MEM_TYPE_READ) == MMU_DIRECT)) return paddr_read_fast(addr, len);
+  return vaddr_mmu_read(addr, len, MEM_TYPE_READ);
+}
+
+static inline void vaddr_write(vaddr_t addr, int len, word_t data) {
+  if (likely(isa_mmu_check(addr, len, MEM_TYPE_WRITE) == MMU_DIRECT)) { paddr_write_fast(addr, len, data); return; }
+  vaddr_mmu_write(addr, len, data);
+}
 
 #endif
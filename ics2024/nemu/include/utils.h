@@ -30,6 +30,18 @@ typedef struct {
 
 extern NEMUState nemu_state;
 
+/* The state is shared with the threads of the other harts while they run,
+ * so it is accessed atomically there. The halt information is read after
+ * the threads are joined.
+ */
+static inline int nemu_state_load() {
+  return __atomic_load_n(&nemu_state.state, __ATOMIC_RELAXED);
+}
+
+static inline void nemu_state_store(int state) {
+  __atomic_store_n(&nemu_state.state, state, __ATOMIC_RELAXED);
+}
+
 // ----------- timer -----------
 
 uint64_t get_time();
@@ -67,11 +79,135 @@ uint64_t get_time();
   } while (0) \
 )
 
+// print a report to the screen, and also to the log file regardless of the window of tracing
+#ifdef CONFIG_TARGET_NATIVE_ELF
+#define log_report(...) \
+  do { \
+    extern FILE* log_fp; \
+    printf(__VA_ARGS__); \
+    if (log_fp != NULL && log_fp != stdout) fprintf(log_fp, __VA_ARGS__); \
+  } while (0)
+#else
+#define log_report(...) printf(__VA_ARGS__)
+#endif
+
 #define _Log(...) \
   do { \
     printf(__VA_ARGS__); \
     log_write(__VA_ARGS__); \
   } while (0)
 
+// ----------- itrace -----------
+
+#ifdef CONFIG_ITRACE
+// raw record of an executed instruction, formatted only when printed
+typedef struct {
+  vaddr_t pc;
+  uint8_t len;
+  uint8_t inst[MUXDEF(CONFIG_ISA_x86, 15, 4)];
+} ItraceRecord;
+
+extern ItraceRecord itrace_buf[CONFIG_ITRACE_SIZE];
+extern uint64_t itrace_nr; // number of instructions ever recorded
+
+static inline void itrace_record(vaddr_t pc, const void *inst, int len) {
+  ItraceRecord *r = &itrace_buf[itrace_nr ++ & (CONFIG_ITRACE_SIZE - 1)];
+  r->pc = pc;
+  r->len = len;
+  memcpy(r->inst, inst, len < sizeof(r->inst) ? len : sizeof(r->inst));
+}
+
+void itrace_format(char *buf, int size, vaddr_t pc, const uint8_t *inst, int len);
+// print the recorded instructions, oldest first
+void itrace_dump();
+#endif
+
+// ----------- elf -----------
+
+typedef struct {
+  vaddr_t start, end; // [start, end)
+  char *name;
+} ElfFunc;
+
+// functions of the guest sorted by address, without overlapping
+extern ElfFunc *elf_func;
+extern int elf_nr_func;
+
+void init_elf(const char *elf_file);
+// index of the function containing `addr', -1 if none
+int elf_func_find(vaddr_t addr);
+
+// ----------- hash table -----------
+
+/* An open-addressing hash table of counters, keyed by a number or by a
+ * string. It grows by rehashing, so entries move when one is added.
+ */
+typedef struct {
+  uint64_t key;    // the number, or the hash of `str'
+  char *str;       // a copy of the string, or NULL
+  bool valid;
+  uint64_t val[2]; // counters of the user
+} HashEntry;
+
+typedef struct {
+  HashEntry *entry;
+  int nr, size;
+} HashTable;
+
+// the entry of the number `key', or of `str' if it is not NULL, added with zero counters if missing
+HashEntry *hash_get(HashTable *t, uint64_t key, const char *str);
+
+// ----------- profile -----------
+
+#ifdef CONFIG_FUNC_PROFILE
+// count an executed instruction, `jump_kind' is given by isa_jump_kind()
+void fprof_step(vaddr_t pc, vaddr_t dnpc, int jump_kind);
+void fprof_report();
+#endif
+
+#ifdef CONFIG_PC_SAMPLE
+extern uint64_t psample_left; // instructions before the next sample
+
+void psample_jump(vaddr_t pc, vaddr_t dnpc, int jump_kind);
+void psample_take(vaddr_t pc);
+
+// sample the shadow stack at `pc' periodically, then track the call or return
+static inline void psample_step(vaddr_t pc, vaddr_t dnpc, int jump_kind) {
+  if (unlikely(-- psample_left == 0)) psample_take(pc);
+  if (unlikely(jump_kind != 0)) psample_jump(pc, dnpc, jump_kind);
+}
+
+void psample_set_file(char *file);
+// write the sampled stacks in the folded format of flamegraph tools
+void psample_report();
+#endif
+
+#ifdef CONFIG_INST_MIX
+extern uint64_t imix_nr_load, imix_nr_store;
+// the block being executed, and the instructions executed in it
+extern vaddr_t imix_block_start;
+extern uint64_t imix_block_len;
+
+void imix_block_end();
+
+// a block runs from the target of a taken control transfer to the next one
+static inline void imix_step(vaddr_t pc, vaddr_t snpc, vaddr_t dnpc) {
+  if (imix_block_len ++ == 0) imix_block_start = pc;
+  if (dnpc != snpc) imix_block_end();
+}
+
+void imix_set_file(char *file);
+// print the instruction mix and the hot blocks, and write them as JSON
+void imix_report();
+#endif
+
+// ----------- stats -----------
+
+#ifndef CONFIG_TARGET_AM
+void stats_set_file(char *file);
+// write host time, simulation speed, device, difftest and trace costs as JSON
+void stats_write();
+#endif
+
 
 #endif
@@ -16,7 +16,13 @@
 -include $(NEMU_HOME)/../Makefile
 include $(NEMU_HOME)/scripts/build.mk
 
+ifdef CONFIG_INSTPAT_TREE
+# the decode tree must be generated before inst.c is compiled
+$(OBJ_DIR)/$(INSTPAT_SRC:%.c=%.o): $(INSTPAT_TREE)
+endif
+
 include $(NEMU_HOME)/tools/difftest.mk
+include $(NEMU_HOME)/tools/bench/bench.mk
 
 compile_git:
 	$(call git_commit, "compile NEMU")
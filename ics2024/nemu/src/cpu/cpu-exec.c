@@ -25,18 +25,79 @@
  */
 #define MAX_INST_TO_PRINT 10
 
+#ifdef CONFIG_MULTI_HART
+CPU_state harts[CONFIG_NR_HART] = {};
+__thread CPU_state *hart_cpu = &harts[0];
+#else
 CPU_state cpu = {};
+#endif
 uint64_t g_nr_guest_inst = 0;
-static uint64_t g_timer = 0; // unit: us
+uint64_t g_nr_guest_inst_base = 0; // restored from a checkpoint, not run in this process
+uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
+bool g_fast_forward = false;
+
+void cpu_set_fast_forward(bool on) {
+  g_fast_forward = on;
+}
 
 void device_update();
+bool log_enable();
 
+#ifdef CONFIG_DEVICE
+extern uint64_t device_poll_left;
+
+// poll devices only when enough instructions have been executed
+static inline void device_poll(uint64_t nr_exec) {
+  if (likely(device_poll_left > nr_exec)) device_poll_left -= nr_exec;
+  else device_update();
+}
+#endif
+uint64_t engine_exec(uint64_t n);
+
+#if defined(CONFIG_THREADED_DISPATCH)
+// instructions run as threaded code before updating devices
+#define THREADED_QUANTUM 4096
+
+static void execute(uint64_t n) {
+  while (n > 0) {
+    uint64_t nr_exec = isa_exec_threaded(n < THREADED_QUANTUM ? n : THREADED_QUANTUM);
+    g_nr_guest_inst += nr_exec;
+    n -= nr_exec;
+    if (nemu_state_load() != NEMU_RUNNING) break;
+    IFDEF(CONFIG_DEVICE, device_poll(nr_exec));
+  }
+}
+#elif !defined(CONFIG_ENGINE_INTERPRETER)
+static void execute(uint64_t n) {
+  while (n > 0) {
+    uint64_t nr_exec = engine_exec(n);
+    n -= nr_exec;
+    if (nemu_state_load() != NEMU_RUNNING) break;
+    IFDEF(CONFIG_DEVICE, device_poll(nr_exec));
+  }
+}
+#else
 static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
-#ifdef CONFIG_ITRACE_COND
-  if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
+#ifdef CONFIG_ITRACE
+  int ilen = _this->snpc - _this->pc;
+  // only inside the window of tracing
+  if (log_enable()) {
+    if (ITRACE_COND) { itrace_record(_this->pc, &_this->isa.inst, ilen); }
+    if (g_print_step) {
+      char buf[128];
+      itrace_format(buf, sizeof(buf), _this->pc, (uint8_t *)&_this->isa.inst, ilen);
+      puts(buf);
+    }
+  }
+#endif
+#if defined(CONFIG_FUNC_PROFILE) || defined(CONFIG_PC_SAMPLE)
+  // only a control transfer can be a call or a return
+  int jump_kind = (dnpc != _this->snpc ? isa_jump_kind(_this) : JUMP_NONE);
+  IFDEF(CONFIG_FUNC_PROFILE, fprof_step(_this->pc, dnpc, jump_kind));
+  IFDEF(CONFIG_PC_SAMPLE, psample_step(_this->pc, dnpc, jump_kind));
 #endif
-  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
+  IFDEF(CONFIG_INST_MIX, imix_step(_this->pc, _this->snpc, dnpc));
   IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
 }
 
@@ -45,53 +106,120 @@ static void exec_once(Decode *s, vaddr_t pc) {
   s->snpc = pc;
   isa_exec_once(s);
   cpu.pc = s->dnpc;
-#ifdef CONFIG_ITRACE
-  char *p = s->logbuf;
-  p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);
-  int ilen = s->snpc - s->pc;
-  int i;
-  uint8_t *inst = (uint8_t *)&s->isa.inst;
-#ifdef CONFIG_ISA_x86
-  for (i = 0; i < ilen; i ++) {
-#else
-  for (i = ilen - 1; i >= 0; i --) {
-#endif
-    p += snprintf(p, 4, " %02x", inst[i]);
+}
+
+#ifdef CONFIG_MULTI_HART
+#include <pthread.h>
+
+/* Hart 0 runs on the main thread. Every other hart started runs on its
+ * own host thread during cpu_exec(), until the state of NEMU changes.
+ */
+static pthread_t hart_thread[CONFIG_NR_HART];
+static pthread_mutex_t hart_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool hart_started[CONFIG_NR_HART] = { true };
+static bool hart_running[CONFIG_NR_HART] = {};
+static uint64_t hart_nr_inst[CONFIG_NR_HART] = {};
+static uint64_t hart_nr_inst_done[CONFIG_NR_HART] = {}; // added to g_nr_guest_inst
+static __thread uint64_t hart_nr_exec = 0; // by the thread of a hart other than 0
+static bool harts_stop = true;
+
+int hart_id() {
+  return hart_cpu - harts;
+}
+
+static void *hart_main(void *arg) {
+  int id = (intptr_t)arg;
+  hart_cpu = &harts[id];
+  Decode s;
+  while (!__atomic_load_n(&harts_stop, __ATOMIC_RELAXED) && nemu_state_load() == NEMU_RUNNING) {
+    exec_once(&s, cpu.pc);
+    hart_nr_exec ++;
   }
-  int ilen_max = MUXDEF(CONFIG_ISA_x86, 8, 4);
-  int space_len = ilen_max - ilen;
-  if (space_len < 0) space_len = 0;
-  space_len = space_len * 3 + 1;
-  memset(p, ' ', space_len);
-  p += space_len;
-
-  void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
-  disassemble(p, s->logbuf + sizeof(s->logbuf) - p,
-      MUXDEF(CONFIG_ISA_x86, s->snpc, s->pc), (uint8_t *)&s->isa.inst, ilen);
-#endif
+  hart_nr_inst[id] = hart_nr_exec;
+  return NULL;
+}
+
+// called with hart_mutex held
+static void hart_launch(int id) {
+  int ret = pthread_create(&hart_thread[id], NULL, hart_main, (void *)(intptr_t)id);
+  Assert(ret == 0, "can not create the thread of hart %d", id);
+  hart_running[id] = true;
+}
+
+void hart_start(int id, vaddr_t pc, word_t sp) {
+  Assert(id > 0 && id < CONFIG_NR_HART, "hart %d can not be started", id);
+  pthread_mutex_lock(&hart_mutex);
+  if (!hart_started[id]) {
+    isa_hart_init(&harts[id], pc, sp);
+    hart_started[id] = true;
+    if (!harts_stop) hart_launch(id);
+  }
+  pthread_mutex_unlock(&hart_mutex);
 }
 
+static void harts_resume() {
+  pthread_mutex_lock(&hart_mutex);
+  __atomic_store_n(&harts_stop, false, __ATOMIC_RELAXED);
+  for (int i = 1; i < CONFIG_NR_HART; i ++) {
+    if (hart_started[i]) hart_launch(i);
+  }
+  pthread_mutex_unlock(&hart_mutex);
+}
+
+static void harts_pause() {
+  // no more harts are launched once harts_stop is set
+  pthread_mutex_lock(&hart_mutex);
+  __atomic_store_n(&harts_stop, true, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&hart_mutex);
+  for (int i = 1; i < CONFIG_NR_HART; i ++) {
+    if (!hart_running[i]) continue;
+    pthread_join(hart_thread[i], NULL);
+    hart_running[i] = false;
+    g_nr_guest_inst += hart_nr_inst[i];
+    hart_nr_inst_done[i] += hart_nr_inst[i];
+    hart_nr_inst[i] = 0;
+  }
+}
+
+uint64_t hart_instret() {
+  int id = hart_id();
+  if (id != 0) return hart_nr_inst_done[id] + hart_nr_exec;
+  // g_nr_guest_inst also counts the others before they are resumed
+  uint64_t nr = g_nr_guest_inst;
+  for (int i = 1; i < CONFIG_NR_HART; i ++) nr -= hart_nr_inst_done[i];
+  return nr;
+}
+#endif
+
 static void execute(uint64_t n) {
   Decode s;
+  IFDEF(CONFIG_MULTI_HART, harts_resume());
   for (;n > 0; n --) {
     exec_once(&s, cpu.pc);
     g_nr_guest_inst ++;
-    trace_and_difftest(&s, cpu.pc);
-    if (nemu_state.state != NEMU_RUNNING) break;
-    IFDEF(CONFIG_DEVICE, device_update());
+    if (likely(!g_fast_forward)) trace_and_difftest(&s, cpu.pc);
+    if (nemu_state_load() != NEMU_RUNNING) break;
+    IFDEF(CONFIG_DEVICE, device_poll(1));
   }
+  IFDEF(CONFIG_MULTI_HART, harts_pause());
 }
+#endif
 
 static void statistic() {
   IFNDEF(CONFIG_TARGET_AM, setlocale(LC_NUMERIC, ""));
 #define NUMBERIC_FMT MUXDEF(CONFIG_TARGET_AM, "%", "%'") PRIu64
   Log("host time spent = " NUMBERIC_FMT " us", g_timer);
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
-  if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
+  if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", (g_nr_guest_inst - g_nr_guest_inst_base) * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  IFDEF(CONFIG_FUNC_PROFILE, fprof_report());
+  IFDEF(CONFIG_PC_SAMPLE, psample_report());
+  IFDEF(CONFIG_INST_MIX, imix_report());
+  IFNDEF(CONFIG_TARGET_AM, stats_write());
 }
 
 void assert_fail_msg() {
+  IFDEF(CONFIG_ITRACE, itrace_dump());
   isa_reg_display();
   statistic();
 }
@@ -117,6 +245,9 @@ void cpu_exec(uint64_t n) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
 
     case NEMU_END: case NEMU_ABORT:
+#ifdef CONFIG_ITRACE
+      if (nemu_state.state == NEMU_ABORT || nemu_state.halt_ret != 0) itrace_dump();
+#endif
       Log("nemu: %s at pc = " FMT_WORD,
           (nemu_state.state == NEMU_ABORT ? ANSI_FMT("ABORT", ANSI_FG_RED) :
            (nemu_state.halt_ret == 0 ? ANSI_FMT("HIT GOOD TRAP", ANSI_FG_GREEN) :
@@ -99,9 +99,17 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
   }
 }
 
+extern bool g_fast_forward;
+
+// host time spent in the reference
+uint64_t difftest_time = 0;
+
 void difftest_step(vaddr_t pc, vaddr_t npc) {
   CPU_state ref_r;
 
+  // the reference is not stepped while fast-forwarding
+  if (g_fast_forward) return;
+
   if (skip_dut_nr_inst > 0) {
     ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
     if (ref_r.pc == npc) {
@@ -122,8 +130,10 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
     return;
   }
 
+  uint64_t start = get_time();
   ref_difftest_exec(1);
   ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+  difftest_time += get_time() - start;
 
   checkregs(&ref_r, pc);
 }
@@ -43,5 +43,5 @@ void init_audio() {
 #endif
 
   sbuf = (uint8_t *)new_space(CONFIG_SB_SIZE);
-  add_mmio_map("audio-sbuf", CONFIG_SB_ADDR, sbuf, CONFIG_SB_SIZE, NULL);
+  add_mmio_ram("audio-sbuf", CONFIG_SB_ADDR, sbuf, CONFIG_SB_SIZE, -1);
 }
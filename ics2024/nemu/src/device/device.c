@@ -28,19 +28,55 @@ void init_i8042();
 void init_audio();
 void init_disk();
 void init_sdcard();
+void init_mpe();
 void init_alarm();
 
 void send_key(uint8_t, bool);
 void vga_update_screen();
+#ifdef CONFIG_MULTI_HART
+void device_lock();
+void device_unlock();
+#endif
+
+// the host clock is read this many times per tick of TIMER_HZ
+#define POLL_PER_TICK 64
+#define POLL_INTERVAL_MIN 64
+#define POLL_INTERVAL_MAX (1 << 24)
+
+static uint64_t poll_interval = CONFIG_DEVICE_POLL_INTERVAL;
+// instructions to execute before the next poll
+uint64_t device_poll_left = CONFIG_DEVICE_POLL_INTERVAL;
+// the updates which are not skipped, and the host time spent in them
+uint64_t device_update_nr = 0, device_update_time = 0;
+
+#ifdef CONFIG_DEVICE_POLL_ADAPTIVE
+// scale the interval by how far the last one is from the target period
+static void poll_calibrate(uint64_t now) {
+  static uint64_t last_poll = 0;
+  const uint64_t target = 1000000 / (TIMER_HZ * POLL_PER_TICK);
+  uint64_t elapsed = now - last_poll;
+  last_poll = now;
+  if (elapsed == 0) poll_interval *= 2;
+  else if (elapsed > 2 * target) poll_interval /= 2;
+  else if (elapsed * 2 < target) poll_interval *= 2;
+  else poll_interval = poll_interval * target / elapsed;
+  if (poll_interval < POLL_INTERVAL_MIN) poll_interval = POLL_INTERVAL_MIN;
+  if (poll_interval > POLL_INTERVAL_MAX) poll_interval = POLL_INTERVAL_MAX;
+}
+#endif
 
 void device_update() {
   static uint64_t last = 0;
   uint64_t now = get_time();
+  IFDEF(CONFIG_DEVICE_POLL_ADAPTIVE, poll_calibrate(now));
+  device_poll_left = poll_interval;
   if (now - last < 1000000 / TIMER_HZ) {
     return;
   }
   last = now;
 
+  // other harts may be accessing the devices
+  IFDEF(CONFIG_MULTI_HART, device_lock());
   IFDEF(CONFIG_HAS_VGA, vga_update_screen());
 
 #ifndef CONFIG_TARGET_AM
@@ -48,7 +84,7 @@ void device_update() {
   while (SDL_PollEvent(&event)) {
     switch (event.type) {
       case SDL_QUIT:
-        nemu_state.state = NEMU_QUIT;
+        nemu_state_store(NEMU_QUIT);
         break;
 #ifdef CONFIG_HAS_KEYBOARD
       // If a key was pressed
@@ -64,6 +100,9 @@ void device_update() {
     }
   }
 #endif
+  IFDEF(CONFIG_MULTI_HART, device_unlock());
+  device_update_nr ++;
+  device_update_time += get_time() - now;
 }
 
 void sdl_clear_event_queue() {
@@ -84,6 +123,7 @@ void init_device() {
   IFDEF(CONFIG_HAS_AUDIO, init_audio());
   IFDEF(CONFIG_HAS_DISK, init_disk());
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
+  IFDEF(CONFIG_HAS_MPE, init_mpe());
 
   IFNDEF(CONFIG_TARGET_AM, init_alarm());
 }
@@ -20,6 +20,16 @@
 
 #define IO_SPACE_MAX (32 * 1024 * 1024)
 
+#ifdef CONFIG_MULTI_HART
+#include <pthread.h>
+
+// devices are shared by all harts, accesses to them are serialized
+static pthread_mutex_t device_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void device_lock() { pthread_mutex_lock(&device_mutex); }
+void device_unlock() { pthread_mutex_unlock(&device_mutex); }
+#endif
+
 static uint8_t *io_space = NULL;
 static uint8_t *p_space = NULL;
 
@@ -32,6 +42,12 @@ uint8_t* new_space(int size) {
   return p;
 }
 
+// the space allocated so far, which holds the registers of devices
+uint8_t* io_space_used(size_t *size) {
+  *size = p_space - io_space;
+  return io_space;
+}
+
 static void check_bound(IOMap *map, paddr_t addr) {
   if (map == NULL) {
     Assert(map != NULL, "address (" FMT_PADDR ") is out of bound at pc = " FMT_WORD, addr, cpu.pc);
@@ -52,19 +68,55 @@ void init_map() {
   p_space = io_space;
 }
 
+void map_table_add(IOMapTable *t, IOMap *map) {
+  assert(map == &t->maps[t->nr_map] && t->nr_map + 1 < MAP_TABLE_SHARED);
+  uint8_t id = t->nr_map + 1;
+  t->nr_map ++;
+  uint64_t first = map->low >> t->shift, last = map->high >> t->shift;
+  for (uint64_t idx = first; idx <= last; idx ++) {
+    // leave the granules beyond the table to the scan
+    if (idx >> (2 * MAP_TABLE_BITS) != 0) break;
+    uint8_t **sub = &t->dir[idx >> MAP_TABLE_BITS];
+    if (*sub == NULL) {
+      *sub = malloc(1 << MAP_TABLE_BITS);
+      assert(*sub);
+      memset(*sub, MAP_TABLE_NONE, 1 << MAP_TABLE_BITS);
+    }
+    uint8_t *e = &(*sub)[idx & ((1 << MAP_TABLE_BITS) - 1)];
+    *e = (*e == MAP_TABLE_NONE ? id : MAP_TABLE_SHARED);
+  }
+}
+
 word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
+  difftest_skip_ref();
   paddr_t offset = addr - map->low;
+  IFDEF(CONFIG_MULTI_HART, device_lock());
+  map->nr_read ++;
   invoke_callback(map->callback, offset, len, false); // prepare data to read
   word_t ret = host_read(map->space + offset, len);
+  IFDEF(CONFIG_MULTI_HART, device_unlock());
   return ret;
 }
 
 void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
+  difftest_skip_ref();
   paddr_t offset = addr - map->low;
+  IFDEF(CONFIG_MULTI_HART, device_lock());
+  map->nr_write ++;
   host_write(map->space + offset, len, data);
   invoke_callback(map->callback, offset, len, true);
+  IFDEF(CONFIG_MULTI_HART, device_unlock());
+}
+
+void map_dump_stats(FILE *fp, IOMap *maps, int nr_map) {
+  fprintf(fp, "[");
+  for (int i = 0; i < nr_map; i ++) {
+    fprintf(fp, "%s\n    { \"name\": \"%s\", \"reads\": %" PRIu64 ", \"writes\": %" PRIu64 " }",
+        (i == 0 ? "" : ","), maps[i].name, maps[i].nr_read, maps[i].nr_write);
+  }
+  fprintf(fp, "%s]", (nr_map == 0 ? "" : "\n  "));
 }
@@ -14,16 +14,17 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/mmio.h>
 #include <memory/paddr.h>
 
 #define NR_MAP 16
 
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
+static IOMapTable table = { .shift = PAGE_SHIFT, .maps = maps };
 
 static IOMap* fetch_mmio_map(paddr_t addr) {
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? NULL : &maps[mapid]);
+  return map_table_find(&table, addr);
 }
 
 static void report_mmio_overlap(const char *name1, paddr_t l1, paddr_t r1,
@@ -50,9 +51,34 @@ void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_
   Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
+  map_table_add(&table, &maps[nr_map]);
   nr_map ++;
 }
 
+MMIORam mmio_ram[NR_MMIO_RAM] = {};
+int nr_mmio_ram = 0;
+
+uint8_t* add_mmio_ram(const char *name, paddr_t addr, void *space, uint32_t len, int dirty_shift) {
+  assert(nr_mmio_ram < NR_MMIO_RAM);
+  // the map still serves the overlap check and the accesses beyond the end
+  add_mmio_map(name, addr, space, len, NULL);
+  uint8_t *dirty = NULL;
+  if (dirty_shift >= 0) {
+    dirty = calloc(((len - 1) >> dirty_shift) + 1, 1);
+    assert(dirty);
+  }
+  mmio_ram[nr_mmio_ram ++] = (MMIORam){ .low = addr, .size = len, .space = space,
+    .dirty = dirty, .dirty_shift = dirty_shift, .map = &maps[nr_map - 1] };
+  return dirty;
+}
+
+void mmio_ram_mark_dirty() {
+  for (int i = 0; i < nr_mmio_ram; i ++) {
+    MMIORam *r = &mmio_ram[i];
+    if (r->dirty != NULL) memset(r->dirty, 1, ((r->size - 1) >> r->dirty_shift) + 1);
+  }
+}
+
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
   return map_read(addr, len, fetch_mmio_map(addr));
@@ -61,3 +87,7 @@ word_t mmio_read(paddr_t addr, int len) {
 void mmio_write(paddr_t addr, int len, word_t data) {
   map_write(addr, len, data, fetch_mmio_map(addr));
 }
+
+void mmio_dump_stats(FILE *fp) {
+  map_dump_stats(fp, maps, nr_map);
+}
@@ -20,6 +20,8 @@
 #define NR_MAP 16
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
+// every port is a granule, so a port is always found without a scan
+static IOMapTable table = { .shift = 0, .maps = maps };
 
 /* device interface */
 void add_pio_map(const char *name, ioaddr_t addr, void *space, uint32_t len, io_callback_t callback) {
@@ -30,20 +32,25 @@ void add_pio_map(const char *name, ioaddr_t addr, void *space, uint32_t len, io_
   Log("Add port-io map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
 
+  map_table_add(&table, &maps[nr_map]);
   nr_map ++;
 }
 
 /* CPU interface */
 uint32_t pio_read(ioaddr_t addr, int len) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  return map_read(addr, len, &maps[mapid]);
+  IOMap *map = map_table_find(&table, addr);
+  assert(map != NULL);
+  return map_read(addr, len, map);
 }
 
 void pio_write(ioaddr_t addr, int len, uint32_t data) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  map_write(addr, len, data, &maps[mapid]);
+  IOMap *map = map_table_find(&table, addr);
+  assert(map != NULL);
+  map_write(addr, len, data, map);
+}
+
+void pio_dump_stats(FILE *fp) {
+  map_dump_stats(fp, maps, nr_map);
 }
@@ -0,0 +1,54 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <cpu/cpu.h>
+
+/* The multi-processor controller.
+ * Write the entry and the stack pointer of a hart first,
+ * then write its id to `start' to start it.
+ */
+enum { reg_nr_hart, reg_hart_id, reg_entry, reg_stack, reg_start, nr_reg };
+
+static uint32_t *mpe_base = NULL;
+
+static void mpe_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(offset % 4 == 0 && offset / 4 < nr_reg);
+  switch (offset / 4) {
+    case reg_hart_id:
+      if (!is_write) { mpe_base[reg_hart_id] = MUXDEF(CONFIG_MULTI_HART, hart_id(), 0); }
+      break;
+    case reg_start:
+      if (is_write) {
+#ifdef CONFIG_MULTI_HART
+        hart_start(mpe_base[reg_start], mpe_base[reg_entry], mpe_base[reg_stack]);
+#else
+        panic("hart %d does not exist", mpe_base[reg_start]);
+#endif
+      }
+      break;
+    default: break;
+  }
+}
+
+void init_mpe() {
+  mpe_base = (uint32_t *)new_space(sizeof(uint32_t) * nr_reg);
+  mpe_base[reg_nr_hart] = MUXDEF(CONFIG_MULTI_HART, CONFIG_NR_HART, 1);
+#ifdef CONFIG_HAS_PORT_IO
+  add_pio_map ("mpe", CONFIG_MPE_CTL_PORT, mpe_base, sizeof(uint32_t) * nr_reg, mpe_io_handler);
+#else
+  add_mmio_map("mpe", CONFIG_MPE_CTL_MMIO, mpe_base, sizeof(uint32_t) * nr_reg, mpe_io_handler);
+#endif
+}
@@ -35,6 +35,38 @@ static void *vmem = NULL;
 static uint32_t *vgactl_port_base = NULL;
 
 #ifdef CONFIG_VGA_SHOW_SCREEN
+// writes to vmem mark granules of 64 bytes, a scanline is dirty if any granule in it is
+#define VMEM_DIRTY_SHIFT 6
+static uint8_t *vmem_dirty = NULL;
+
+/* Pass every band of consecutive dirty scanlines to `upload', and clean them
+ * before it, so that a write during the upload is seen by the next frame.
+ * Return whether anything is uploaded.
+ */
+static bool upload_dirty(void (*upload)(int y, int h)) {
+  uint32_t pitch = screen_width() * sizeof(uint32_t);
+  int h = screen_height(), y0 = -1;
+  bool any = false;
+  for (int y = 0; y <= h; y ++) {
+    uint32_t first = (y * pitch) >> VMEM_DIRTY_SHIFT;
+    bool dirty = false;
+    if (y < h) {
+      uint32_t last = ((y + 1) * pitch - 1) >> VMEM_DIRTY_SHIFT;
+      dirty = memchr(vmem_dirty + first, 1, last - first + 1) != NULL;
+    }
+    if (dirty && y0 < 0) y0 = y;
+    if (!dirty && y0 >= 0) {
+      uint32_t band_first = (y0 * pitch) >> VMEM_DIRTY_SHIFT;
+      uint32_t band_last = (y * pitch - 1) >> VMEM_DIRTY_SHIFT;
+      memset(vmem_dirty + band_first, 0, band_last - band_first + 1);
+      upload(y0, y - y0);
+      y0 = -1;
+      any = true;
+    }
+  }
+  return any;
+}
+
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
 
@@ -56,8 +88,14 @@ static void init_screen() {
   SDL_RenderPresent(renderer);
 }
 
+static void upload_band(int y, int h) {
+  SDL_Rect rect = { .x = 0, .y = y, .w = SCREEN_W, .h = h };
+  SDL_UpdateTexture(texture, &rect, (uint32_t *)vmem + y * SCREEN_W, SCREEN_W * sizeof(uint32_t));
+}
+
 static inline void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(uint32_t));
+  // nothing is changed since the last frame
+  if (!upload_dirty(upload_band)) return;
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, texture, NULL, NULL);
   SDL_RenderPresent(renderer);
@@ -65,15 +103,21 @@ static inline void update_screen() {
 #else
 static void init_screen() {}
 
+static void upload_band(int y, int h) {
+  io_write(AM_GPU_FBDRAW, 0, y, (uint32_t *)vmem + y * screen_width(), screen_width(), h, false);
+}
+
 static inline void update_screen() {
-  io_write(AM_GPU_FBDRAW, 0, 0, vmem, screen_width(), screen_height(), true);
+  if (upload_dirty(upload_band)) io_write(AM_GPU_FBDRAW, 0, 0, NULL, 0, 0, true);
 }
 #endif
 #endif
 
 void vga_update_screen() {
-  // TODO: call `update_screen()` when the sync register is non-zero,
-  // then zero out the sync register
+  if (vgactl_port_base[1] != 0) {
+    IFDEF(CONFIG_VGA_SHOW_SCREEN, update_screen());
+    vgactl_port_base[1] = 0;
+  }
 }
 
 void init_vga() {
@@ -86,7 +130,13 @@ void init_vga() {
 #endif
 
   vmem = new_space(screen_size());
-  add_mmio_map("vmem", CONFIG_FB_ADDR, vmem, screen_size(), NULL);
-  IFDEF(CONFIG_VGA_SHOW_SCREEN, init_screen());
-  IFDEF(CONFIG_VGA_SHOW_SCREEN, memset(vmem, 0, screen_size()));
+#ifdef CONFIG_VGA_SHOW_SCREEN
+  vmem_dirty = add_mmio_ram("vmem", CONFIG_FB_ADDR, vmem, screen_size(), VMEM_DIRTY_SHIFT);
+  init_screen();
+  memset(vmem, 0, screen_size());
+  // the first frame uploads the whole screen
+  memset(vmem_dirty, 1, ((screen_size() - 1) >> VMEM_DIRTY_SHIFT) + 1);
+#else
+  add_mmio_ram("vmem", CONFIG_FB_ADDR, vmem, screen_size(), -1);
+#endif
 }
@@ -0,0 +1,141 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/cpu.h>
+#include <cpu/decode.h>
+#include <cpu/difftest.h>
+#include <memory/paddr.h>
+
+#define MAX_BLOCK_INST 64
+#define NR_BLOCK  8192
+#define NR_BUCKET 8192
+#define POOL_SIZE (NR_BLOCK * 16)
+
+typedef struct Block {
+  vaddr_t pc;
+  int nr_inst;
+  Decode *inst;
+  struct Block *next; // next block in the same bucket
+} Block;
+
+static Block blocks[NR_BLOCK] = {};
+static int nr_block = 0;
+static Block *bucket[NR_BUCKET] = {};
+
+// the decoding results of all blocks are allocated from this pool
+static Decode pool[POOL_SIZE] = {};
+static int pool_used = 0;
+
+// bumped whenever all blocks are dropped
+static uint64_t block_gen = 0;
+
+extern uint64_t g_nr_guest_inst;
+
+#define bucket_of(pc) (&bucket[((pc) >> 2) & (NR_BUCKET - 1)])
+
+static void block_flush() {
+  memset(bucket, 0, sizeof(bucket));
+  nr_block = 0;
+  pool_used = 0;
+  block_gen ++;
+}
+
+// Blocks are small and self-modifying code is rare,
+// so simply drop all blocks when code is written.
+void block_cache_invalidate(paddr_t addr) {
+  block_flush();
+}
+
+static Block* block_lookup(vaddr_t pc) {
+  Block *b;
+  for (b = *bucket_of(pc); b != NULL; b = b->next) {
+    if (b->pc == pc) return b;
+  }
+  return NULL;
+}
+
+static inline bool block_continue(Decode *s, uint64_t gen) {
+  return nemu_state_load() == NEMU_RUNNING && s->dnpc == s->snpc && gen == block_gen;
+}
+
+/* Discover the block at `cpu.pc' by interpreting its instructions one by one,
+ * and record their decoding results. The block ends at the first instruction
+ * which does not fall through, or when the block is full.
+ */
+static uint64_t block_build(uint64_t n) {
+  if (nr_block == NR_BLOCK || pool_used + MAX_BLOCK_INST > POOL_SIZE) {
+    block_flush();
+  }
+
+  uint64_t gen = block_gen;
+  Block *b = &blocks[nr_block];
+  b->pc = cpu.pc;
+  b->inst = &pool[pool_used];
+
+  int i = 0;
+  bool end = false;
+  while (i < n && i < MAX_BLOCK_INST && in_pmem(cpu.pc)) {
+    Decode *s = &b->inst[i ++];
+    s->pc = cpu.pc;
+    s->snpc = cpu.pc;
+    isa_exec_once(s);
+    cpu.pc = s->dnpc;
+    g_nr_guest_inst ++;
+    IFDEF(CONFIG_DIFFTEST, difftest_step(s->pc, cpu.pc));
+    if (!block_continue(s, gen)) { end = true; break; }
+  }
+
+  if (i == 0) {
+    // code outside pmem may be changed by devices, so it is never cached
+    Decode s;
+    s.pc = cpu.pc;
+    s.snpc = cpu.pc;
+    isa_exec_once(&s);
+    cpu.pc = s.dnpc;
+    g_nr_guest_inst ++;
+    IFDEF(CONFIG_DIFFTEST, difftest_step(s.pc, cpu.pc));
+    return 1;
+  }
+
+  // a block cut short by `n' is not the whole block, do not keep it
+  if (gen == block_gen && (end || i == MAX_BLOCK_INST || !in_pmem(cpu.pc))) {
+    b->nr_inst = i;
+    b->next = *bucket_of(b->pc);
+    *bucket_of(b->pc) = b;
+    nr_block ++;
+    pool_used += i;
+  }
+  return i;
+}
+
+/* Execute the block at `cpu.pc', but no more than `n' instructions.
+ * Return the number of instructions executed.
+ */
+uint64_t engine_exec(uint64_t n) {
+  Block *b = block_lookup(cpu.pc);
+  if (b == NULL) return block_build(n);
+
+  uint64_t gen = block_gen;
+  Decode *s = b->inst;
+  Decode *end = s + (b->nr_inst < n ? b->nr_inst : n);
+  while (s < end) {
+    isa_exec_decoded(s);
+    cpu.pc = s->dnpc;
+    g_nr_guest_inst ++;
+    IFDEF(CONFIG_DIFFTEST, difftest_step(s->pc, cpu.pc));
+    if (!block_continue(s ++, gen)) break;
+  }
+  return s - b->inst;
+}
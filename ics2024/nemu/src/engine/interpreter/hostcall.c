@@ -17,12 +17,21 @@
 #include <cpu/ifetch.h>
 #include <isa.h>
 #include <cpu/difftest.h>
+#ifdef CONFIG_MULTI_HART
+#include <pthread.h>
+#endif
 
 void set_nemu_state(int state, vaddr_t pc, int halt_ret) {
   difftest_skip_ref();
-  nemu_state.state = state;
+#ifdef CONFIG_MULTI_HART
+  // harts may stop at the same time, keep the halt information of one of them
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_mutex_lock(&lock);
+#endif
   nemu_state.halt_pc = pc;
   nemu_state.halt_ret = halt_ret;
+  nemu_state_store(state);
+  IFDEF(CONFIG_MULTI_HART, pthread_mutex_unlock(&lock));
 }
 
 __attribute__((noinline))
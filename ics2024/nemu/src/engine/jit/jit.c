@@ -0,0 +1,251 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/cpu.h>
+#include <cpu/decode.h>
+#include <cpu/difftest.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <sys/mman.h>
+#include "jit.h"
+
+#define CODE_CACHE_SIZE (16 * 1024 * 1024)
+// the largest translation of a block, including its out-of-line code
+#define MAX_BLOCK_CODE  (MAX_BLOCK_INST * 128 + 256)
+#define NR_BLOCK  65536
+#define NR_BUCKET 8192
+
+// Blocks are translated one instruction at a time under difftest,
+// so that the reference can be stepped after each of them.
+#define MAX_BLOCK_INST MUXDEF(CONFIG_DIFFTEST, 1, 64)
+// instructions run by one call of engine_exec(), so that devices are still updated
+#define QUANTUM        MUXDEF(CONFIG_DIFFTEST, 1, 16384)
+
+typedef struct JitBlock {
+  vaddr_t pc;
+  int nr_inst;
+  uint8_t *code;  // NULL if the first instruction can not be translated
+  struct JitBlock *next; // next block in the same bucket
+} JitBlock;
+
+static JitBlock blocks[NR_BLOCK] = {};
+static int nr_block = 0;
+static JitBlock *bucket[NR_BUCKET] = {};
+
+static uint8_t *code_cache = NULL;
+static uint8_t *code_start = NULL; // translated blocks start here
+uint8_t *code_ptr = NULL;
+
+// uint64_t enter(CPU_state *cpu, uint64_t budget, uint8_t *code), return the remaining budget
+static uint64_t (*enter)(CPU_state *, uint64_t, uint8_t *) = NULL;
+static uint8_t *exit_stub = NULL;
+
+// the rel32 field of the last taken exit, set by the exit stub
+static uint8_t *chain_site = NULL;
+static uint64_t chain_gen = 0;
+
+// bumped whenever all blocks are dropped
+static uint64_t jit_gen = 0;
+static bool jit_flushed = false;
+bool jit_mmio_exit = false;
+
+extern uint64_t g_nr_guest_inst;
+
+#define bucket_of(pc) (&bucket[((pc) >> 2) & (NR_BUCKET - 1)])
+
+static void jit_flush() {
+  memset(bucket, 0, sizeof(bucket));
+  nr_block = 0;
+  code_ptr = code_start;
+  jit_gen ++;
+  jit_flushed = true;
+}
+
+// Self-modifying code is rare, so simply drop all blocks when code is written.
+// The block running now is left untouched until the next translation.
+void block_cache_invalidate(paddr_t addr) {
+  jit_flush();
+}
+
+static void init_jit() {
+  code_cache = mmap(NULL, CODE_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  Assert(code_cache != MAP_FAILED, "Can not allocate the code cache of JIT");
+  code_ptr = code_cache;
+
+  // the trampoline keeps the stack 16-byte aligned for helper calls
+  enter = (void *)code_ptr;
+  emit8(0x55);                         // push rbp
+  emit8(0x53);                         // push rbx
+  emit8(0x41); emit8(0x54);            // push r12
+  emit8(0x41); emit8(0x55);            // push r13
+  emit8(0x41); emit8(0x56);            // push r14
+  emit8(0x41); emit8(0x57);            // push r15
+  emit8(0x48); emit8(0x83); emit8(0xec); emit8(0x08); // sub rsp, 8
+  emit8(0x48); emit8(0x89); emit8(0xfb); // mov rbx, rdi
+  emit8(0x49); emit8(0x89); emit8(0xf4); // mov r12, rsi
+  emit8(0xff); emit8(0xe2);            // jmp rdx
+
+  exit_stub = code_ptr;
+  emit8(0x48); emit8(0xb8); emit64((uintptr_t)&chain_site); // mov rax, &chain_site
+  emit8(0x4c); emit8(0x89); emit8(0x28); // mov [rax], r13
+  emit8(0x4c); emit8(0x89); emit8(0xe0); // mov rax, r12
+  emit8(0x48); emit8(0x83); emit8(0xc4); emit8(0x08); // add rsp, 8
+  emit8(0x41); emit8(0x5f);            // pop r15
+  emit8(0x41); emit8(0x5e);            // pop r14
+  emit8(0x41); emit8(0x5d);            // pop r13
+  emit8(0x41); emit8(0x5c);            // pop r12
+  emit8(0x5b);                         // pop rbx
+  emit8(0x5d);                         // pop rbp
+  emit8(0xc3);                         // ret
+
+  code_start = code_ptr;
+}
+
+void emit_exit(vaddr_t pc, bool chain) {
+  emit_store_cpu_imm(CPU_OFF(pc), pc);
+  if (chain) {
+    // r13 = the rel32 field of the jmp below, which is 11 bytes away
+    emit_mov_r13((uintptr_t)code_ptr + 11);
+  } else {
+    emit_clear_r13();
+  }
+  patch_rel32(emit_jmp(), exit_stub);
+}
+
+void emit_exit_indirect() {
+  emit_clear_r13();
+  patch_rel32(emit_jmp(), exit_stub);
+}
+
+static JitBlock* jit_lookup(vaddr_t pc) {
+  JitBlock *b;
+  for (b = *bucket_of(pc); b != NULL; b = b->next) {
+    if (b->pc == pc) return b;
+  }
+  return NULL;
+}
+
+/* Translate the block at `pc'. It ends at the first instruction which does
+ * not fall through, before the first instruction which can not be translated,
+ * or when it is full.
+ */
+static JitBlock* jit_translate(vaddr_t pc) {
+  if (nr_block == NR_BLOCK || code_ptr + MAX_BLOCK_CODE > code_cache + CODE_CACHE_SIZE) {
+    jit_flush();
+  }
+
+  JitBlock *b = &blocks[nr_block ++];
+  b->pc = pc;
+  b->code = code_ptr;
+  b->next = *bucket_of(pc);
+  *bucket_of(pc) = b;
+
+  // cmp r12, nr; jb budget; sub r12, nr
+  emit_cmp_r12(0);
+  uint8_t *cmp_imm = code_ptr - 4;
+  uint8_t *budget = emit_jcc(CC_B);
+  emit_sub_r12(0);
+  uint8_t *sub_imm = code_ptr - 4;
+
+  int i = 0;
+  int ret = TRANS_FAIL;
+  while (i < MAX_BLOCK_INST && in_pmem(pc)) {
+    Decode s;
+    s.pc = pc;
+    isa_decode(&s);
+    ret = translate_inst(&s, i);
+    if (ret == TRANS_FAIL) break;
+    pmem_watch_code(pc);
+    pc = s.snpc;
+    i ++;
+    if (ret == TRANS_END) break;
+  }
+
+  b->nr_inst = i;
+  if (i == 0) {
+    code_ptr = b->code;
+    b->code = NULL;
+    return b;
+  }
+
+  if (ret != TRANS_END) emit_exit(pc, true);
+  memcpy(cmp_imm, &i, 4);
+  memcpy(sub_imm, &i, 4);
+
+  // not enough budget for the whole block
+  patch_rel32(budget, code_ptr);
+  emit_store_cpu_imm(CPU_OFF(pc), b->pc);
+  emit_exit_indirect();
+
+  translate_block_end(i);
+  Assert(code_ptr <= b->code + MAX_BLOCK_CODE, "translation of block at " FMT_WORD " is too large", b->pc);
+  return b;
+}
+
+bool jit_write(vaddr_t addr, int len, word_t data) {
+  jit_flushed = false;
+  vaddr_write(addr, len, data);
+  return jit_flushed;
+}
+
+word_t jit_read(vaddr_t addr, int len) {
+  return vaddr_read(addr, len);
+}
+
+static uint64_t interpret_once() {
+  Decode s;
+  s.pc = cpu.pc;
+  s.snpc = cpu.pc;
+  isa_exec_once(&s);
+  cpu.pc = s.dnpc;
+  g_nr_guest_inst ++;
+  IFDEF(CONFIG_DIFFTEST, difftest_step(s.pc, cpu.pc));
+  return 1;
+}
+
+/* Execute the translated code from `cpu.pc', but no more than `n' instructions.
+ * Return the number of instructions executed.
+ */
+uint64_t engine_exec(uint64_t n) {
+  if (unlikely(code_cache == NULL)) init_jit();
+
+  // code outside pmem may be changed by devices, so it is never translated
+  if (!in_pmem(cpu.pc)) return interpret_once();
+
+  JitBlock *b = jit_lookup(cpu.pc);
+  if (b == NULL) b = jit_translate(cpu.pc);
+
+  // let the last exit jump to this block directly next time
+  if (chain_site != NULL && chain_gen == jit_gen && b->code != NULL) {
+    patch_rel32(chain_site, b->code);
+  }
+  chain_site = NULL;
+
+  if (b->code == NULL || b->nr_inst > n) return interpret_once();
+
+  IFDEF(CONFIG_DIFFTEST, vaddr_t pc = cpu.pc);
+  if (n > QUANTUM) n = QUANTUM;
+  chain_gen = jit_gen;
+  uint64_t nr_exec = n - enter(&cpu, n, b->code);
+  g_nr_guest_inst += nr_exec;
+  IFDEF(CONFIG_DIFFTEST, if (nr_exec > 0) difftest_step(pc, cpu.pc));
+  // the budget given back by the exit covers the access left to the interpreter
+  if (jit_mmio_exit) {
+    jit_mmio_exit = false;
+    nr_exec += interpret_once();
+  }
+  return nr_exec;
+}
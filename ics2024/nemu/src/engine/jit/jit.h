@@ -0,0 +1,133 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <isa.h>
+#include <stddef.h>
+
+#if !defined(__x86_64__)
+#error "the JIT engine only generates x86-64 code"
+#endif
+
+/* Register usage of the translated code:
+ *   rbx - &cpu
+ *   r12 - number of guest instructions which can still be executed
+ *   r13 - address of the rel32 field to patch for chaining, or 0
+ * Other registers are scratch, and are clobbered by helper calls.
+ */
+enum { EAX = 0, ECX = 1, EDX = 2, EBX = 3, ESI = 6, EDI = 7 };
+
+// condition codes of jcc/setcc
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_L = 0xc, CC_GE = 0xd };
+
+// ALU operations, both as the /ext of opcode 0x81 and (ext << 3 | 1) for opcode "op r/m32, r32"
+enum { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+
+// shift operations as the /ext of opcode 0xc1 and 0xd3
+enum { SFT_SHL = 4, SFT_SHR = 5, SFT_SAR = 7 };
+
+extern uint8_t *code_ptr;
+
+static inline void emit8 (uint8_t x)  { *code_ptr ++ = x; }
+static inline void emit32(uint32_t x) { memcpy(code_ptr, &x, 4); code_ptr += 4; }
+static inline void emit64(uint64_t x) { memcpy(code_ptr, &x, 8); code_ptr += 8; }
+
+// set the rel32 field at `site' to jump to `target'
+static inline void patch_rel32(uint8_t *site, uint8_t *target) {
+  int32_t rel = target - (site + 4);
+  memcpy(site, &rel, 4);
+}
+
+// displacement of a field in CPU_state
+#define CPU_OFF(field) ((uint32_t)offsetof(CPU_state, field))
+#define GPR_OFF(idx)   (CPU_OFF(gpr) + (idx) * sizeof(word_t))
+
+// mov r32, [rbx + off]
+static inline void emit_load_cpu(int r, uint32_t off)  { emit8(0x8b); emit8(0x83 | (r << 3)); emit32(off); }
+// mov [rbx + off], r32
+static inline void emit_store_cpu(int r, uint32_t off) { emit8(0x89); emit8(0x83 | (r << 3)); emit32(off); }
+// mov dword [rbx + off], imm32
+static inline void emit_store_cpu_imm(uint32_t off, uint32_t imm) { emit8(0xc7); emit8(0x83); emit32(off); emit32(imm); }
+// mov dst, src
+static inline void emit_mov(int dst, int src) { emit8(0x89); emit8(0xc0 | (src << 3) | dst); }
+// mov r32, imm32
+static inline void emit_mov_imm(int r, uint32_t imm) { emit8(0xb8 + r); emit32(imm); }
+// op r32, imm32
+static inline void emit_alu_imm(int op, int r, uint32_t imm) { emit8(0x81); emit8(0xc0 | (op << 3) | r); emit32(imm); }
+// op dst, src
+static inline void emit_alu(int op, int dst, int src) { emit8((op << 3) | 1); emit8(0xc0 | (src << 3) | dst); }
+// op r32, [rbx + off]
+static inline void emit_alu_cpu(int op, int r, uint32_t off) { emit8((op << 3) | 3); emit8(0x83 | (r << 3)); emit32(off); }
+// shift r32, imm8
+static inline void emit_shift_imm(int op, int r, uint8_t imm) { emit8(0xc1); emit8(0xc0 | (op << 3) | r); emit8(imm); }
+// shift r32, cl
+static inline void emit_shift_cl(int op, int r) { emit8(0xd3); emit8(0xc0 | (op << 3) | r); }
+// setcc r8; movzx r32, r8 (only for eax, ecx and edx)
+static inline void emit_setcc(int cc, int r) {
+  emit8(0x0f); emit8(0x90 | cc); emit8(0xc0 | r);
+  emit8(0x0f); emit8(0xb6); emit8(0xc0 | (r << 3) | r);
+}
+// movsx/movzx eax, al/ax
+static inline void emit_ext_eax(bool sign, int len) {
+  emit8(0x0f); emit8((sign ? 0xbe : 0xb6) | (len == 2)); emit8(0xc0);
+}
+// test al, al (a bool returned by a helper is only defined in al)
+static inline void emit_test_al() { emit8(0x84); emit8(0xc0); }
+// mov rax, imm64; mov byte [rax], 1
+static inline void emit_set_flag(bool *flag) { emit8(0x48); emit8(0xb8); emit64((uintptr_t)flag); emit8(0xc6); emit8(0x00); emit8(0x01); }
+// mov rax, imm64; call rax
+static inline void emit_call(void *fn) { emit8(0x48); emit8(0xb8); emit64((uintptr_t)fn); emit8(0xff); emit8(0xd0); }
+// jmp rel32, return the address of the rel32 field
+static inline uint8_t* emit_jmp() { emit8(0xe9); emit32(0); return code_ptr - 4; }
+// jcc rel32, return the address of the rel32 field
+static inline uint8_t* emit_jcc(int cc) { emit8(0x0f); emit8(0x80 | cc); emit32(0); return code_ptr - 4; }
+// cmp r12, imm32
+static inline void emit_cmp_r12(uint32_t imm) { emit8(0x49); emit8(0x81); emit8(0xfc); emit32(imm); }
+// sub r12, imm32
+static inline void emit_sub_r12(uint32_t imm) { emit8(0x49); emit8(0x81); emit8(0xec); emit32(imm); }
+// add r12, imm32
+static inline void emit_add_r12(uint32_t imm) { emit8(0x49); emit8(0x81); emit8(0xc4); emit32(imm); }
+// mov r13, imm64
+static inline void emit_mov_r13(uint64_t imm) { emit8(0x49); emit8(0xbd); emit64(imm); }
+// xor r13d, r13d
+static inline void emit_clear_r13() { emit8(0x45); emit8(0x31); emit8(0xed); }
+
+// --- interface between the code cache and the translator ---
+
+// memory accesses of the translated code
+word_t jit_read(vaddr_t addr, int len);
+// return true if the write flushes the translated code
+bool jit_write(vaddr_t addr, int len, word_t data);
+
+// set when the translated code leaves before an access outside pmem,
+// which is then left to the interpreter
+extern bool jit_mmio_exit;
+
+// leave the translated code with cpu.pc = `pc', and chain to the block at `pc' later if `chain'
+void emit_exit(vaddr_t pc, bool chain);
+// leave the translated code with cpu.pc already written
+void emit_exit_indirect();
+
+/* Translate one instruction decoded by isa_decode() at `code_ptr'.
+ * `nr_inst' is the index of the instruction in the block.
+ */
+enum { TRANS_FAIL, TRANS_OK, TRANS_END };
+int translate_inst(struct Decode *s, int nr_inst);
+// emit the out-of-line code of the block with `nr_inst' instructions
+void translate_block_end(int nr_inst);
+
+#endif
@@ -0,0 +1,264 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+/* Translation of riscv32 instructions to x86-64.
+ *
+ * An instruction is translated by the INSTPAT it matches in inst.c: the
+ * execution body of the pattern matching a sample encoding of each kind of
+ * instruction is recorded once, so the translated code never runs an
+ * instruction the interpreter rejects. Operands are decoded from the raw
+ * bits here, independent of how the patterns in inst.c decode them.
+ * Anything else ends the block and is left to the interpreter.
+ */
+
+#include <cpu/decode.h>
+#include "jit.h"
+
+#define RD(i)  BITS(i, 11, 7)
+#define RS1(i) BITS(i, 19, 15)
+#define RS2(i) BITS(i, 24, 20)
+#define immI(i) ((word_t)SEXT(BITS(i, 31, 20), 12))
+#define immU(i) ((word_t)BITS(i, 31, 12) << 12)
+#define immS(i) ((word_t)(SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7))
+#define immB(i) ((word_t)(SEXT(BITS(i, 31, 31), 1) << 12) | (BITS(i, 7, 7) << 11) | \
+    (BITS(i, 30, 25) << 5) | (BITS(i, 11, 8) << 1))
+#define immJ(i) ((word_t)(SEXT(BITS(i, 31, 31), 1) << 20) | (BITS(i, 19, 12) << 12) | \
+    (BITS(i, 20, 20) << 11) | (BITS(i, 30, 21) << 1))
+
+/* Side exits of the block, to be finished by translate_block_end(): stores
+ * which may modify the code, and accesses outside pmem, which are left to
+ * the interpreter.
+ */
+static struct {
+  uint8_t *site;  // rel32 field of the jcc to the exit
+  int nr_inst;    // instructions executed before leaving
+  vaddr_t pc;     // where the interpreter goes on
+  bool mmio;      // the instruction at `pc' is not executed yet
+} side_exit[64];
+static int nr_side_exit = 0;
+
+static bool reg_ok(int idx) {
+  return !(MUXDEF(CONFIG_RVE, idx >= 16, false));
+}
+
+static void load_reg(int r, int idx) {
+  if (idx == 0) emit_mov_imm(r, 0);
+  else emit_load_cpu(r, GPR_OFF(idx));
+}
+
+static void store_reg(int r, int idx) {
+  if (idx != 0) emit_store_cpu(r, GPR_OFF(idx));
+}
+
+// leave the block before the instruction if the address in edi is outside pmem
+static bool emit_pmem_guard(Decode *s, int len, int nr_inst) {
+  if (nr_side_exit == ARRLEN(side_exit)) return false;
+  emit_mov(EAX, EDI);
+  emit_alu_imm(ALU_SUB, EAX, CONFIG_MBASE);
+  emit_alu_imm(ALU_CMP, EAX, CONFIG_MSIZE - len);
+  side_exit[nr_side_exit ++] = (typeof(side_exit[0])) {
+    .site = emit_jcc(CC_A), .nr_inst = nr_inst, .pc = s->pc, .mmio = true };
+  return true;
+}
+
+static int trans_lui(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  if (rd != 0) emit_store_cpu_imm(GPR_OFF(rd), immU(s->isa.inst));
+  return TRANS_OK;
+}
+
+static int trans_auipc(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  if (rd != 0) emit_store_cpu_imm(GPR_OFF(rd), s->pc + immU(s->isa.inst));
+  return TRANS_OK;
+}
+
+static int trans_op_imm(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  uint32_t i = s->isa.inst;
+  word_t imm = immI(i);
+  if (rd == 0) return TRANS_OK;
+  load_reg(EAX, rs1);
+  switch (BITS(i, 14, 12)) {
+    case 0: emit_alu_imm(ALU_ADD, EAX, imm); break;
+    case 2: emit_alu_imm(ALU_CMP, EAX, imm); emit_setcc(CC_L, EAX); break;
+    case 3: emit_alu_imm(ALU_CMP, EAX, imm); emit_setcc(CC_B, EAX); break;
+    case 4: emit_alu_imm(ALU_XOR, EAX, imm); break;
+    case 6: emit_alu_imm(ALU_OR,  EAX, imm); break;
+    case 7: emit_alu_imm(ALU_AND, EAX, imm); break;
+    case 1: emit_shift_imm(SFT_SHL, EAX, RS2(i)); break;
+    case 5: emit_shift_imm(BITS(i, 30, 30) ? SFT_SAR : SFT_SHR, EAX, RS2(i)); break;
+  }
+  store_reg(EAX, rd);
+  return TRANS_OK;
+}
+
+static int trans_op(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  uint32_t i = s->isa.inst;
+  bool alt = BITS(i, 30, 30);
+  if (rd == 0) return TRANS_OK;
+  load_reg(EAX, rs1);
+  load_reg(ECX, rs2);
+  switch (BITS(i, 14, 12)) {
+    case 0: emit_alu(alt ? ALU_SUB : ALU_ADD, EAX, ECX); break;
+    case 1: emit_shift_cl(SFT_SHL, EAX); break;
+    case 2: emit_alu(ALU_CMP, EAX, ECX); emit_setcc(CC_L, EAX); break;
+    case 3: emit_alu(ALU_CMP, EAX, ECX); emit_setcc(CC_B, EAX); break;
+    case 4: emit_alu(ALU_XOR, EAX, ECX); break;
+    case 5: emit_shift_cl(alt ? SFT_SAR : SFT_SHR, EAX); break;
+    case 6: emit_alu(ALU_OR,  EAX, ECX); break;
+    case 7: emit_alu(ALU_AND, EAX, ECX); break;
+  }
+  store_reg(EAX, rd);
+  return TRANS_OK;
+}
+
+static int trans_load(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  uint32_t i = s->isa.inst;
+  int funct3 = BITS(i, 14, 12);
+  int len = 1 << (funct3 & 3);
+  load_reg(EDI, rs1);
+  emit_alu_imm(ALU_ADD, EDI, immI(i));
+  if (!emit_pmem_guard(s, len, nr_inst)) return TRANS_FAIL;
+  emit_mov_imm(ESI, len);
+  emit_call(jit_read);
+  if (len < 4) emit_ext_eax(!(funct3 & 4), len);
+  store_reg(EAX, rd);
+  return TRANS_OK;
+}
+
+static int trans_store(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  uint32_t i = s->isa.inst;
+  int len = 1 << BITS(i, 13, 12);
+  // the guard and the check of the write take two side exits
+  if (nr_side_exit + 2 > ARRLEN(side_exit)) return TRANS_FAIL;
+  load_reg(EDI, rs1);
+  emit_alu_imm(ALU_ADD, EDI, immS(i));
+  emit_pmem_guard(s, len, nr_inst);
+  emit_mov_imm(ESI, len);
+  load_reg(EDX, rs2);
+  emit_call(jit_write);
+  emit_test_al();
+  side_exit[nr_side_exit ++] = (typeof(side_exit[0])) {
+    .site = emit_jcc(CC_NE), .nr_inst = nr_inst + 1, .pc = s->pc + 4, .mmio = false };
+  return TRANS_OK;
+}
+
+static int trans_branch(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  static const int cc[] = { CC_E, CC_NE, -1, -1, CC_L, CC_GE, CC_B, CC_AE };
+  uint32_t i = s->isa.inst;
+  int c = cc[BITS(i, 14, 12)];
+  if (c == -1) return TRANS_FAIL;
+  load_reg(EAX, rs1);
+  if (rs2 == 0) emit_alu_imm(ALU_CMP, EAX, 0);
+  else emit_alu_cpu(ALU_CMP, EAX, GPR_OFF(rs2));
+  uint8_t *taken = emit_jcc(c);
+  emit_exit(s->pc + 4, true);
+  patch_rel32(taken, code_ptr);
+  emit_exit(s->pc + immB(i), true);
+  return TRANS_END;
+}
+
+static int trans_jal(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  if (rd != 0) emit_store_cpu_imm(GPR_OFF(rd), s->pc + 4);
+  emit_exit(s->pc + immJ(s->isa.inst), true);
+  return TRANS_END;
+}
+
+static int trans_jalr(Decode *s, int rd, int rs1, int rs2, int nr_inst) {
+  load_reg(EAX, rs1);
+  emit_alu_imm(ALU_ADD, EAX, immI(s->isa.inst));
+  emit_alu_imm(ALU_AND, EAX, ~1u);
+  emit_store_cpu(EAX, CPU_OFF(pc));
+  if (rd != 0) emit_store_cpu_imm(GPR_OFF(rd), s->pc + 4);
+  emit_exit_indirect();
+  return TRANS_END;
+}
+
+typedef int (*trans_t)(Decode *s, int rd, int rs1, int rs2, int nr_inst);
+
+// a sample encoding of every kind of instruction, with its translator
+static const struct {
+  uint32_t inst;
+  trans_t trans;
+} table[] = {
+  { 0x00000037, trans_lui }, { 0x00000017, trans_auipc },       // lui, auipc
+  { 0x0000006f, trans_jal }, { 0x00000067, trans_jalr },        // jal, jalr
+  { 0x00000063, trans_branch }, { 0x00001063, trans_branch },   // beq, bne
+  { 0x00004063, trans_branch }, { 0x00005063, trans_branch },   // blt, bge
+  { 0x00006063, trans_branch }, { 0x00007063, trans_branch },   // bltu, bgeu
+  { 0x00000003, trans_load }, { 0x00001003, trans_load },       // lb, lh
+  { 0x00002003, trans_load }, { 0x00004003, trans_load },       // lw, lbu
+  { 0x00005003, trans_load },                                   // lhu
+  { 0x00000023, trans_store }, { 0x00001023, trans_store },     // sb, sh
+  { 0x00002023, trans_store },                                  // sw
+  { 0x00000013, trans_op_imm }, { 0x00002013, trans_op_imm },   // addi, slti
+  { 0x00003013, trans_op_imm }, { 0x00004013, trans_op_imm },   // sltiu, xori
+  { 0x00006013, trans_op_imm }, { 0x00007013, trans_op_imm },   // ori, andi
+  { 0x00001013, trans_op_imm }, { 0x00005013, trans_op_imm },   // slli, srli
+  { 0x40005013, trans_op_imm },                                 // srai
+  { 0x00000033, trans_op }, { 0x40000033, trans_op },           // add, sub
+  { 0x00001033, trans_op }, { 0x00002033, trans_op },           // sll, slt
+  { 0x00003033, trans_op }, { 0x00004033, trans_op },           // sltu, xor
+  { 0x00005033, trans_op }, { 0x40005033, trans_op },           // srl, sra
+  { 0x00006033, trans_op }, { 0x00007033, trans_op },           // or, and
+};
+
+// the execution body of the pattern matching each sample, or NULL
+static const void *handler[ARRLEN(table)];
+
+/* A sample which is not implemented matches the pattern of invalid
+ * instructions, and a pattern matching samples of different translators
+ * is not specific enough. Neither of them is translated.
+ */
+static void init_handler() {
+  Decode s = { .pc = 0, .snpc = 0 };
+  isa_decode_inst(&s, 0);
+  const void *inv = s.isa.handler;
+  for (int k = 0; k < ARRLEN(table); k ++) {
+    isa_decode_inst(&s, table[k].inst);
+    handler[k] = (s.isa.handler == inv ? NULL : s.isa.handler);
+  }
+  for (int k = 0; k < ARRLEN(table); k ++) {
+    for (int j = 0; j < k; j ++) {
+      if (handler[j] != NULL && handler[j] == handler[k] && table[j].trans != table[k].trans) {
+        handler[j] = handler[k] = NULL;
+      }
+    }
+  }
+}
+
+int translate_inst(Decode *s, int nr_inst) {
+  static bool handler_ready = false;
+  if (!handler_ready) { init_handler(); handler_ready = true; }
+
+  uint32_t i = s->isa.inst;
+  int rd = RD(i), rs1 = RS1(i), rs2 = RS2(i);
+  if (nr_inst == 0) nr_side_exit = 0;
+  if (s->isa.handler == NULL || !reg_ok(rd) || !reg_ok(rs1) || !reg_ok(rs2)) return TRANS_FAIL;
+
+  for (int k = 0; k < ARRLEN(table); k ++) {
+    if (s->isa.handler == handler[k]) return table[k].trans(s, rd, rs1, rs2, nr_inst);
+  }
+  return TRANS_FAIL;
+}
+
+void translate_block_end(int nr_inst) {
+  for (int k = 0; k < nr_side_exit; k ++) {
+    patch_rel32(side_exit[k].site, code_ptr);
+    // give back the budget of the instructions not executed
+    emit_add_r12(nr_inst - side_exit[k].nr_inst);
+    if (side_exit[k].mmio) emit_set_flag(&jit_mmio_exit);
+    emit_exit(side_exit[k].pc, false);
+  }
+  nr_side_exit = 0;
+}
@@ -17,6 +17,7 @@ SRCS-y += src/nemu-main.c
 DIRS-y += src/cpu src/monitor src/utils
 DIRS-$(CONFIG_MODE_SYSTEM) += src/memory
 DIRS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/sdb
+SRCS-BLACKLIST-$(CONFIG_TARGET_AM) += src/monitor/farm.c src/monitor/checkpoint.c src/monitor/sample.c src/utils/elf.c src/utils/stats.c
 
 SHARE = $(if $(CONFIG_TARGET_SHARE),1,0)
 LIBS += $(if $(CONFIG_TARGET_NATIVE_ELF),-lreadline -ldl -pie,)
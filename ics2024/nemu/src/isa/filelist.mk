@@ -15,3 +15,20 @@
 
 INC_PATH += $(NEMU_HOME)/src/isa/$(GUEST_ISA)/include
 DIRS-y += src/isa/$(GUEST_ISA)
+
+ifdef CONFIG_INSTPAT_TREE
+GEN_DECODE_PATH := $(NEMU_HOME)/tools/gen-decode
+GEN_DECODE      := $(GEN_DECODE_PATH)/build/gen-decode
+INSTPAT_SRC     := src/isa/$(GUEST_ISA)/inst.c
+INSTPAT_TREE    := $(NEMU_HOME)/build/gen-$(GUEST_ISA)/inst-decode.h
+INC_PATH += $(dir $(INSTPAT_TREE))
+
+$(GEN_DECODE):
+	@$(MAKE) -s -C $(GEN_DECODE_PATH)
+
+$(INSTPAT_TREE): $(INSTPAT_SRC) $(GEN_DECODE)
+	@echo + GEN $@
+	@mkdir -p $(dir $@)
+	@$(GEN_DECODE) $< > $@.tmp
+	@mv $@.tmp $@
+endif
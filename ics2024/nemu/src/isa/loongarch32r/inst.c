@@ -17,10 +17,13 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#ifdef CONFIG_INSTPAT_TREE
+#include <inst-decode.h> // generated by tools/gen-decode
+#endif
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
+#define Mr(addr, len) (INST_LOAD(1), vaddr_read(addr, len))
+#define Mw(addr, len, data) (INST_STORE(1), vaddr_write(addr, len, data))
 
 enum {
   TYPE_2RI12, TYPE_1RI20,
@@ -51,6 +54,7 @@ static int decode_exec(Decode *s) {
   int rd = 0; \
   word_t src1 = 0, src2 = 0, imm = 0; \
   decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
+  INSTPAT_COUNT(name); \
   __VA_ARGS__ ; \
 }
 
@@ -72,3 +76,13 @@ int isa_exec_once(Decode *s) {
   s->isa.inst = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
+
+int isa_jump_kind(Decode *s) {
+  uint32_t i = s->isa.inst;
+  if (BITS(i, 31, 26) == 0x15) return JUMP_CALL; // bl
+  if (BITS(i, 31, 26) == 0x13) { // jirl
+    if (BITS(i, 4, 0) == 1) return JUMP_CALL;
+    if (BITS(i, 4, 0) == 0 && BITS(i, 9, 5) == 1) return JUMP_RET; // jirl $zero, $ra, 0
+  }
+  return JUMP_NONE;
+}
@@ -21,11 +21,18 @@
 typedef struct {
   word_t gpr[MUXDEF(CONFIG_RVE, 16, 32)];
   vaddr_t pc;
+  // reservation set by lr, not compared in difftest
+  bool rsv_valid;
+  vaddr_t rsv_addr;
+  word_t rsv_val;
 } MUXDEF(CONFIG_RV64, riscv64_CPU_state, riscv32_CPU_state);
 
 // decode
 typedef struct {
   uint32_t inst;
+  uint8_t rd, rs1, rs2;
+  word_t imm;
+  IFDEF(CONFIG_DECODE_CACHE, const void *handler); // execution body of the matched pattern
 } MUXDEF(CONFIG_RV64, riscv64_ISADecodeInfo, riscv32_ISADecodeInfo);
 
 #define isa_mmu_check(vaddr, len, type) (MMU_DIRECT)
@@ -34,6 +34,16 @@ static void restart() {
   cpu.gpr[0] = 0;
 }
 
+#ifdef CONFIG_MULTI_HART
+void isa_hart_init(CPU_state *hart, vaddr_t pc, word_t sp) {
+  // start with the registers of the hart starting it
+  *hart = cpu;
+  hart->pc = pc;
+  hart->gpr[2] = sp;
+  hart->rsv_valid = false;
+}
+#endif
+
 void init_isa() {
   /* Load built-in image. */
   memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
@@ -17,28 +17,37 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#ifdef CONFIG_INSTPAT_TREE
+#include <inst-decode.h> // generated by tools/gen-decode
+#endif
+#include <memory/paddr.h>
+#include <cpu/difftest.h>
 
 #define R(i) gpr(i)
-#define Mr vaddr_read
-#define Mw vaddr_write
+#define Mr(addr, len) (INST_LOAD(1), vaddr_read(addr, len))
+#define Mw(addr, len, data) (INST_STORE(1), vaddr_write(addr, len, data))
 
 enum {
-  TYPE_I, TYPE_U, TYPE_S,
+  TYPE_R, TYPE_I, TYPE_U, TYPE_S,
   TYPE_N, // none
 };
 
-#define src1R() do { *src1 = R(rs1); } while (0)
-#define src2R() do { *src2 = R(rs2); } while (0)
-#define immI() do { *imm = SEXT(BITS(i, 31, 20), 12); } while(0)
-#define immU() do { *imm = SEXT(BITS(i, 31, 12), 20) << 12; } while(0)
-#define immS() do { *imm = (SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7); } while(0)
+#define src1R() do { s->isa.rs1 = BITS(i, 19, 15); } while (0)
+#define src2R() do { s->isa.rs2 = BITS(i, 24, 20); } while (0)
+#define immI() do { s->isa.imm = SEXT(BITS(i, 31, 20), 12); } while(0)
+#define immU() do { s->isa.imm = SEXT(BITS(i, 31, 12), 20) << 12; } while(0)
+#define immS() do { s->isa.imm = (SEXT(BITS(i, 31, 25), 7) << 5) | BITS(i, 11, 7); } while(0)
 
-static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_t *imm, int type) {
+// Only register indices are recorded here, since the decoding result may be
+// reused from the decode cache. The operands are read right before execution.
+static void decode_operand(Decode *s, int type) {
   uint32_t i = s->isa.inst;
-  int rs1 = BITS(i, 19, 15);
-  int rs2 = BITS(i, 24, 20);
-  *rd     = BITS(i, 11, 7);
+  s->isa.rd  = BITS(i, 11, 7);
+  s->isa.rs1 = 0;
+  s->isa.rs2 = 0;
+  s->isa.imm = 0;
   switch (type) {
+    case TYPE_R: src1R(); src2R();         break;
     case TYPE_I: src1R();          immI(); break;
     case TYPE_U:                   immU(); break;
     case TYPE_S: src1R(); src2R(); immS(); break;
@@ -47,15 +56,184 @@ static void decode_operand(Decode *s, int *rd, word_t *src1, word_t *src2, word_
   }
 }
 
+#ifdef CONFIG_RV_A
+// The reservation of lr is checked by comparing the value, so sc may
+// succeed after the memory is written with the same value in between.
+static word_t lr(vaddr_t addr) {
+  word_t val = Mr(addr, 4);
+  cpu.rsv_valid = true;
+  cpu.rsv_addr = addr;
+  cpu.rsv_val = val;
+  return val;
+}
+
+static word_t sc(vaddr_t addr, word_t data) {
+  bool ok = false;
+  if (cpu.rsv_valid && cpu.rsv_addr == addr) {
+    INST_LOAD(1); INST_STORE(1);
+    ok = vaddr_cas(addr, 4, cpu.rsv_val, data);
+  }
+  cpu.rsv_valid = false;
+  return !ok;
+}
+
+// an AMO both loads and stores
+static word_t amo(vaddr_t addr, int op, word_t src) {
+  INST_LOAD(1); INST_STORE(1);
+  return vaddr_amo(addr, 4, op, src);
+}
+#endif
+
+extern uint64_t g_nr_guest_inst;
+
+#ifdef CONFIG_THREADED_DISPATCH
+// instructions left to run by isa_exec_threaded(), 0 if not running threaded code
+static uint64_t thread_left = 0;
+// the number of instructions retired when thread_left reaches 0
+static uint64_t thread_inst_end = 0;
+#endif
+
+// instructions retired before the executing one
+static uint64_t nr_retired() {
+#if defined(CONFIG_MULTI_HART)
+  return hart_instret();
+#elif defined(CONFIG_THREADED_DISPATCH)
+  // g_nr_guest_inst is only updated after a run of threaded code
+  return thread_inst_end - thread_left;
+#else
+  return g_nr_guest_inst;
+#endif
+}
+
+// written values of mcycle and minstret are kept as offsets to the counters
+static uint64_t mcycle_offset = 0, minstret_offset = 0;
+
+enum {
+  CSR_MCYCLE = 0xb00, CSR_MINSTRET = 0xb02, CSR_MCYCLEH = 0xb80, CSR_MINSTRETH = 0xb82,
+  CSR_CYCLE = 0xc00, CSR_TIME = 0xc01, CSR_INSTRET = 0xc02,
+  CSR_CYCLEH = 0xc80, CSR_TIMEH = 0xc81, CSR_INSTRETH = 0xc82,
+};
+
+// Only the counters are implemented. The user ones are read-only.
+static uint64_t *csr_counter(int csr, uint64_t *val) {
+  uint64_t instret = nr_retired();
+  switch (csr & ~0x80) {
+    case CSR_MCYCLE: case CSR_CYCLE: *val = instret * CONFIG_RV_CPI + mcycle_offset; return &mcycle_offset;
+    case CSR_MINSTRET: case CSR_INSTRET: *val = instret + minstret_offset; return &minstret_offset;
+    // a write to mcycle does not move time
+    case CSR_TIME: *val = instret * CONFIG_RV_CPI / CONFIG_RV_TIME_DIV; return NULL;
+    default: return NULL;
+  }
+}
+
+static bool csr_valid(int csr) {
+  if (MUXDEF(CONFIG_RV64, csr & 0x80, false)) return false; // no high halves
+  switch (csr & ~0x80) {
+    case CSR_MCYCLE: case CSR_MINSTRET: case CSR_CYCLE: case CSR_TIME: case CSR_INSTRET: return true;
+    default: return false;
+  }
+}
+
+enum { CSR_W, CSR_S, CSR_C };
+
+// read the csr in the immediate of `s', and update it if `wen'
+static word_t csr_op(Decode *s, int op, word_t src, bool wen) {
+  int csr = s->isa.imm & 0xfff;
+  if (!csr_valid(csr)) { INV(s->pc); return 0; }
+  // the counters of the reference do not run the same way
+  IFDEF(CONFIG_DIFFTEST, difftest_skip_ref());
+  uint64_t val;
+  uint64_t *offset = csr_counter(csr, &val);
+  int shift = (csr & 0x80) ? 32 : 0;
+  word_t old = val >> shift;
+  if (wen) {
+    if (offset == NULL || (csr & 0xf00) == 0xc00) { INV(s->pc); return 0; }
+    word_t new = (op == CSR_W ? src : op == CSR_S ? (old | src) : (old & ~src));
+    uint64_t mask = (uint64_t)(word_t)-1 << shift;
+    uint64_t new_val = (val & ~mask) | ((uint64_t)new << shift);
+    // the written value is seen by the next instruction, without the
+    // increment by this one
+    uint64_t step = (offset == &minstret_offset ? 1 : CONFIG_RV_CPI);
+    *offset += new_val - val - step;
+  }
+  return old;
+}
+
+#ifdef CONFIG_DECODE_CACHE
+#ifdef CONFIG_THREADED_DISPATCH
+// threaded code runs on the entries directly, so they are whole Decode
+typedef Decode DecodeCacheEntry;
+#else
+typedef struct {
+  vaddr_t pc;
+  ISADecodeInfo isa;
+} DecodeCacheEntry;
+#endif
+
+static DecodeCacheEntry dcache[CONFIG_DECODE_CACHE_SIZE] = {};
+static uint64_t dcache_gen = 0;
+
+#define dcache_entry(pc) (&dcache[((pc) >> 2) & (CONFIG_DECODE_CACHE_SIZE - 1)])
+
+static_assert((CONFIG_DECODE_CACHE_SIZE & (CONFIG_DECODE_CACHE_SIZE - 1)) == 0,
+    "CONFIG_DECODE_CACHE_SIZE should be a power of 2");
+
+// set by isa_decode() to stop right after the pattern is matched
+static bool decode_only = false;
+
+// Record where the execution body of the matched pattern is,
+// then a hit in the decode cache can jump to it directly.
+#define INSTPAT_HANDLER(s, label) \
+  (s)->isa.handler = &&label; \
+  if (decode_only) goto *(__instpat_end); \
+  label:
+#else
+#define INSTPAT_HANDLER(s, label)
+#endif
+
+#ifdef CONFIG_THREADED_DISPATCH
+/* Finish the instruction, and jump to the execution body of the next one
+ * if it is in the decode cache. Otherwise return to isa_exec_threaded().
+ */
+#define INSTPAT_NEXT(s) \
+  if (thread_left != 0) { \
+    R(0) = 0; \
+    cpu.pc = (s)->dnpc; \
+    if (-- thread_left != 0 && likely(nemu_state_load() == NEMU_RUNNING)) { \
+      Decode *__next = dcache_entry(cpu.pc); \
+      if (likely(__next->pc == cpu.pc && __next->isa.handler != NULL)) { \
+        (s) = __next; \
+        (s)->dnpc = (s)->snpc; \
+        goto *(s)->isa.handler; \
+      } \
+    } \
+  }
+#else
+#define INSTPAT_NEXT(s)
+#endif
+
+#ifdef CONFIG_DECODE_CACHE
+// The address of a label is only valid in the same copy of the function,
+// so decode_exec() must not be inlined or cloned to different callers.
+#ifdef __clang__
+__attribute__((noinline))
+#else
+__attribute__((noinline, noclone))
+#endif
+#endif
 static int decode_exec(Decode *s) {
   s->dnpc = s->snpc;
 
 #define INSTPAT_INST(s) ((s)->isa.inst)
 #define INSTPAT_MATCH(s, name, type, ... /* execute body */ ) { \
-  int rd = 0; \
-  word_t src1 = 0, src2 = 0, imm = 0; \
-  decode_operand(s, &rd, &src1, &src2, &imm, concat(TYPE_, type)); \
+  decode_operand(s, concat(TYPE_, type)); \
+  INSTPAT_HANDLER(s, concat(__instpat_exec_, __LINE__)); \
+  INSTPAT_COUNT(name); \
+  int rd = s->isa.rd; \
+  word_t src1 = R(s->isa.rs1), src2 = R(s->isa.rs2), imm = s->isa.imm; \
+  (void)rd; (void)src1; (void)src2; (void)imm; \
   __VA_ARGS__ ; \
+  INSTPAT_NEXT(s); \
 }
 
   INSTPAT_START();
@@ -63,6 +241,27 @@ static int decode_exec(Decode *s) {
   INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, R(rd) = Mr(src1 + imm, 1));
   INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, Mw(src1 + imm, 1, src2));
 
+#ifdef CONFIG_RV_A
+  INSTPAT("00010?? 00000 ????? 010 ????? 01011 11", lr.w     , R, R(rd) = lr(src1));
+  INSTPAT("00011?? ????? ????? 010 ????? 01011 11", sc.w     , R, R(rd) = sc(src1, src2));
+  INSTPAT("00001?? ????? ????? 010 ????? 01011 11", amoswap.w, R, R(rd) = amo(src1, AMO_SWAP, src2));
+  INSTPAT("00000?? ????? ????? 010 ????? 01011 11", amoadd.w , R, R(rd) = amo(src1, AMO_ADD , src2));
+  INSTPAT("00100?? ????? ????? 010 ????? 01011 11", amoxor.w , R, R(rd) = amo(src1, AMO_XOR , src2));
+  INSTPAT("01100?? ????? ????? 010 ????? 01011 11", amoand.w , R, R(rd) = amo(src1, AMO_AND , src2));
+  INSTPAT("01000?? ????? ????? 010 ????? 01011 11", amoor.w  , R, R(rd) = amo(src1, AMO_OR  , src2));
+  INSTPAT("10000?? ????? ????? 010 ????? 01011 11", amomin.w , R, R(rd) = amo(src1, AMO_MIN , src2));
+  INSTPAT("10100?? ????? ????? 010 ????? 01011 11", amomax.w , R, R(rd) = amo(src1, AMO_MAX , src2));
+  INSTPAT("11000?? ????? ????? 010 ????? 01011 11", amominu.w, R, R(rd) = amo(src1, AMO_MINU, src2));
+  INSTPAT("11100?? ????? ????? 010 ????? 01011 11", amomaxu.w, R, R(rd) = amo(src1, AMO_MAXU, src2));
+#endif
+
+  INSTPAT("??????? ????? ????? 001 ????? 11100 11", csrrw  , I, R(rd) = csr_op(s, CSR_W, src1, true));
+  INSTPAT("??????? ????? ????? 010 ????? 11100 11", csrrs  , I, R(rd) = csr_op(s, CSR_S, src1, s->isa.rs1 != 0));
+  INSTPAT("??????? ????? ????? 011 ????? 11100 11", csrrc  , I, R(rd) = csr_op(s, CSR_C, src1, s->isa.rs1 != 0));
+  INSTPAT("??????? ????? ????? 101 ????? 11100 11", csrrwi , I, R(rd) = csr_op(s, CSR_W, s->isa.rs1, true));
+  INSTPAT("??????? ????? ????? 110 ????? 11100 11", csrrsi , I, R(rd) = csr_op(s, CSR_S, s->isa.rs1, s->isa.rs1 != 0));
+  INSTPAT("??????? ????? ????? 111 ????? 11100 11", csrrci , I, R(rd) = csr_op(s, CSR_C, s->isa.rs1, s->isa.rs1 != 0));
+
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak , N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
   INSTPAT_END();
@@ -72,7 +271,104 @@ static int decode_exec(Decode *s) {
   return 0;
 }
 
+#ifdef CONFIG_DECODE_CACHE
+
+void decode_cache_invalidate(paddr_t addr) {
+  vaddr_t page = ROUNDDOWN(addr, PAGE_SIZE);
+  for (vaddr_t pc = page; pc - page < PAGE_SIZE; pc += 4) {
+    DecodeCacheEntry *e = dcache_entry(pc);
+    if (e->pc == pc) { e->isa.handler = NULL; }
+  }
+  dcache_gen ++;
+}
+
+int isa_exec_once(Decode *s) {
+  DecodeCacheEntry *e = dcache_entry(s->pc);
+  if (likely(e->pc == s->pc && e->isa.handler != NULL)) {
+    s->isa = e->isa;
+    s->snpc += 4;
+    return decode_exec(s);
+  }
+
+  s->isa.handler = NULL;
+  s->isa.inst = inst_fetch(&s->snpc, 4);
+  if (!in_pmem(s->pc)) { return decode_exec(s); }
+
+  // The instruction may overwrite itself. Watch the page before executing
+  // it, and do not fill the entry if the page is written in the meantime.
+  pmem_watch_code(s->pc);
+  uint64_t gen = dcache_gen;
+  int ret = decode_exec(s);
+  if (gen == dcache_gen) {
+    e->pc = s->pc;
+    e->isa = s->isa;
+    IFDEF(CONFIG_THREADED_DISPATCH, e->snpc = s->snpc);
+  }
+  return ret;
+}
+
+int isa_exec_decoded(Decode *s) {
+  return decode_exec(s);
+}
+
+#ifdef CONFIG_THREADED_DISPATCH
+uint64_t isa_exec_threaded(uint64_t n) {
+  uint64_t nr_exec = 0;
+  while (nr_exec < n && nemu_state_load() == NEMU_RUNNING) {
+    DecodeCacheEntry *e = dcache_entry(cpu.pc);
+    if (e->pc == cpu.pc && e->isa.handler != NULL) {
+      // run until a miss in the decode cache
+      thread_left = n - nr_exec;
+      thread_inst_end = g_nr_guest_inst + n;
+      e->dnpc = e->snpc;
+      decode_exec(e);
+      nr_exec = n - thread_left;
+      thread_left = 0;
+    } else {
+      thread_inst_end = g_nr_guest_inst + nr_exec;
+      Decode s;
+      s.pc = cpu.pc;
+      s.snpc = cpu.pc;
+      isa_exec_once(&s);
+      cpu.pc = s.dnpc;
+      nr_exec ++;
+    }
+  }
+  return nr_exec;
+}
+#endif
+
+int isa_decode(Decode *s) {
+  s->snpc = s->pc;
+  return isa_decode_inst(s, inst_fetch(&s->snpc, 4));
+}
+
+int isa_decode_inst(Decode *s, uint32_t inst) {
+  s->isa.handler = NULL;
+  s->isa.inst = inst;
+  decode_only = true;
+  int ret = decode_exec(s);
+  decode_only = false;
+  return ret;
+}
+#else
 int isa_exec_once(Decode *s) {
   s->isa.inst = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
+#endif
+
+// x1 and x5 are the link registers in the calling convention
+#define is_link(r) ((r) == 1 || (r) == 5)
+
+int isa_jump_kind(Decode *s) {
+  uint32_t i = s->isa.inst;
+  int rd = BITS(i, 11, 7), rs1 = BITS(i, 19, 15);
+  switch (BITS(i, 6, 0)) {
+    case 0x6f: return is_link(rd) ? JUMP_CALL : JUMP_NONE; // jal
+    case 0x67: // jalr
+      if (is_link(rd)) return JUMP_CALL;
+      return (rd == 0 && is_link(rs1)) ? JUMP_RET : JUMP_NONE;
+    default: return JUMP_NONE;
+  }
+}
@@ -119,8 +119,8 @@ static void decode_rm(Decode *s, int *rm_reg, word_t *rm_addr, int *reg, int wid
 
 #define Rr reg_read
 #define Rw reg_write
-#define Mr vaddr_read
-#define Mw vaddr_write
+#define Mr(addr, len) (INST_LOAD(1), vaddr_read(addr, len))
+#define Mw(addr, len, data) (INST_STORE(1), vaddr_write(addr, len, data))
 #define RMr(reg, w)  (reg != -1 ? Rr(reg, w) : Mr(addr, w))
 #define RMw(data) do { if (rd != -1) Rw(rd, w, data); else Mw(addr, w, data); } while (0)
 
@@ -152,6 +152,7 @@ enum {
   word_t src1 = 0, addr = 0, imm = 0; \
   int w = width == 0 ? (is_operand_size_16 ? 2 : 4) : width; \
   decode_operand(s, opcode, &rd, &src1, &addr, &rs, &gp_idx, &imm, w, concat(TYPE_, type)); \
+  INSTPAT_COUNT(name); \
   __VA_ARGS__ ; \
 }
 
@@ -217,3 +218,16 @@ again:
 
   return 0;
 }
+
+int isa_jump_kind(Decode *s) {
+  // fetch again, since the instruction is not always kept in `s'
+  vaddr_t pc = s->pc;
+  uint8_t opcode = inst_fetch(&pc, 1);
+  if (opcode == 0x66) opcode = inst_fetch(&pc, 1);
+  switch (opcode) {
+    case 0xe8: return JUMP_CALL;
+    case 0xc2: case 0xc3: return JUMP_RET;
+    case 0xff: return ((inst_fetch(&pc, 1) >> 3) & 0x7) == 2 ? JUMP_CALL : JUMP_NONE; // call r/m
+    default: return JUMP_NONE;
+  }
+}
@@ -15,18 +15,163 @@
 
 #include <memory/host.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <cpu/decode.h>
 #include <device/mmio.h>
 #include <isa.h>
 
-#if   defined(CONFIG_PMEM_MALLOC)
-static uint8_t *pmem = NULL;
+#if   defined(CONFIG_PMEM_MALLOC) || defined(CONFIG_PMEM_SPARSE)
+uint8_t *pmem = NULL;
 #else // CONFIG_PMEM_GARRAY
-static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
+uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 #endif
 
 uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
 paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
 
+#ifdef CONFIG_DECODE_CACHE
+bool pmem_code_page[CONFIG_MSIZE >> PAGE_SHIFT] = {};
+
+void pmem_watch_code(paddr_t addr) {
+  pmem_code_page[(addr - CONFIG_MBASE) >> PAGE_SHIFT] = true;
+}
+
+void pmem_code_written(paddr_t addr) {
+  pmem_code_page[(addr - CONFIG_MBASE) >> PAGE_SHIFT] = false;
+  decode_cache_invalidate(addr);
+  IFNDEF(CONFIG_ENGINE_INTERPRETER, block_cache_invalidate(addr));
+}
+#endif
+
+#ifdef CONFIG_TARGET_NATIVE_ELF
+#include <sys/mman.h>
+#include <errno.h>
+#endif
+
+#ifdef CONFIG_MEM_RANDOM_LAZY
+#include <signal.h>
+
+static uint8_t mem_random = 0;
+static struct sigaction old_segv_action;
+// pages which are accessible, the others are still inaccessible
+static bool pmem_touched[CONFIG_MSIZE >> PAGE_SHIFT] = {};
+
+static void pmem_touch(uint8_t *start, uint8_t *end) {
+  for (; start < end; start += PAGE_SIZE) pmem_touched[(start - pmem) >> PAGE_SHIFT] = true;
+}
+
+// the first access to a page of pmem, fill it with the random value
+static void pmem_segv_handler(int sig, siginfo_t *info, void *ucontext) {
+  uint8_t *addr = info->si_addr;
+  if (addr >= pmem && addr < pmem + CONFIG_MSIZE) {
+    uint8_t *page = pmem + ((addr - pmem) & ~PAGE_MASK);
+    if (mprotect(page, PAGE_SIZE, PROT_READ | PROT_WRITE) == 0) {
+      memset(page, mem_random, PAGE_SIZE);
+      pmem_touch(page, page + PAGE_SIZE);
+      return;
+    }
+  }
+  // a real fault, crash as usual at the next try
+  sigaction(SIGSEGV, &old_segv_action, NULL);
+}
+
+static void init_mem_lazy() {
+  mem_random = rand();
+  struct sigaction s;
+  memset(&s, 0, sizeof(s));
+  s.sa_sigaction = pmem_segv_handler;
+  s.sa_flags = SA_SIGINFO;
+  int ret = sigaction(SIGSEGV, &s, &old_segv_action);
+  Assert(ret == 0, "Can not set signal handler");
+  ret = mprotect(pmem, CONFIG_MSIZE, PROT_NONE);
+  Assert(ret == 0, "Can not protect pmem");
+}
+
+void pmem_prepare_write(paddr_t addr, size_t len) {
+  uint8_t *start = guest_to_host(ROUNDDOWN(addr, PAGE_SIZE));
+  uint8_t *end = guest_to_host(ROUNDUP(addr + len, PAGE_SIZE));
+  // a page which is not fully written is initialized by the first access
+  if (addr % PAGE_SIZE != 0) { (void)*(volatile uint8_t *)start; start += PAGE_SIZE; }
+  if ((addr + len) % PAGE_SIZE != 0 && end > start) {
+    (void)*(volatile uint8_t *)(end - PAGE_SIZE); end -= PAGE_SIZE;
+  }
+  if (end > start) {
+    mprotect(start, end - start, PROT_READ | PROT_WRITE);
+    pmem_touch(start, end);
+  }
+}
+
+bool pmem_page_touched(paddr_t addr) {
+  return pmem_touched[(addr - CONFIG_MBASE) >> PAGE_SHIFT];
+}
+#endif
+
+#ifdef CONFIG_PMEM_HUGEPAGE
+#define HUGEPAGE_SIZE (2ul << 20)
+
+static void pmem_advise_hugepage(uint8_t *start, uint8_t *end) {
+  start = (uint8_t *)ROUNDUP(start, HUGEPAGE_SIZE);
+  end = (uint8_t *)ROUNDDOWN(end, HUGEPAGE_SIZE);
+  if (end > start && madvise(start, end - start, MADV_HUGEPAGE) != 0) {
+    Log("madvise(MADV_HUGEPAGE) failed: %s, using normal pages", strerror(errno));
+  }
+}
+
+// sum up AnonHugePages of the mappings covering pmem
+static void pmem_hugepage_report() {
+  FILE *fp = fopen("/proc/self/smaps", "r");
+  if (fp == NULL) return;
+  uintptr_t lo = (uintptr_t)pmem, hi = lo + CONFIG_MSIZE;
+  bool in_pmem = false;
+  size_t huge_kb = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    uintptr_t start, end;
+    size_t kb;
+    if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2) {
+      in_pmem = start < hi && end > lo;
+    } else if (in_pmem && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+      huge_kb += kb;
+    }
+  }
+  fclose(fp);
+  Log("huge pages: %zu KB of %zu KB pmem", huge_kb, (size_t)CONFIG_MSIZE >> 10);
+}
+#endif
+
+void pmem_clear(paddr_t addr, size_t len) {
+  uint8_t *p = guest_to_host(addr);
+#ifdef CONFIG_TARGET_NATIVE_ELF
+  // replace whole pages with new zero pages, which are not populated until touched
+  if ((uintptr_t)p % PAGE_SIZE == 0 && len % PAGE_SIZE == 0 && len > 0 &&
+      mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED |
+        MUXDEF(CONFIG_PMEM_SPARSE, MAP_NORESERVE, 0), -1, 0) == p) {
+    IFDEF(CONFIG_PMEM_HUGEPAGE, pmem_advise_hugepage(p, p + len));
+    IFDEF(CONFIG_MEM_RANDOM_LAZY, pmem_touch(p, p + len));
+    return;
+  }
+#endif
+  IFDEF(CONFIG_MEM_RANDOM_LAZY, pmem_prepare_write(addr, len));
+  memset(p, 0, len);
+}
+
+void pmem_randomize(paddr_t addr, size_t len) {
+#if defined(CONFIG_MEM_RANDOM_LAZY)
+  // make the pages inaccessible again, and forget their contents
+  uint8_t *p = guest_to_host(addr);
+  Assert((uintptr_t)p % PAGE_SIZE == 0 && len % PAGE_SIZE == 0, "pages to randomize are not aligned");
+  if (len == 0) return;
+  void *ret = mmap(p, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED |
+      MUXDEF(CONFIG_PMEM_SPARSE, MAP_NORESERVE, 0), -1, 0);
+  Assert(ret == p, "Can not protect pmem");
+  memset(&pmem_touched[(addr - CONFIG_MBASE) >> PAGE_SHIFT], 0, len >> PAGE_SHIFT);
+#elif defined(CONFIG_MEM_RANDOM)
+  memset(guest_to_host(addr), rand(), len);
+#else
+  pmem_clear(addr, len);
+#endif
+}
+
 static word_t pmem_read(paddr_t addr, int len) {
   word_t ret = host_read(guest_to_host(addr), len);
   return ret;
@@ -34,6 +179,7 @@ static word_t pmem_read(paddr_t addr, int len) {
 
 static void pmem_write(paddr_t addr, int len, word_t data) {
   host_write(guest_to_host(addr), len, data);
+  IFDEF(CONFIG_DECODE_CACHE, pmem_check_code(addr, len));
 }
 
 static void out_of_bound(paddr_t addr) {
@@ -45,20 +191,119 @@ void init_mem() {
 #if   defined(CONFIG_PMEM_MALLOC)
   pmem = malloc(CONFIG_MSIZE);
   assert(pmem);
+#elif defined(CONFIG_PMEM_SPARSE)
+  size_t align = MUXDEF(CONFIG_PMEM_HUGEPAGE, HUGEPAGE_SIZE, PAGE_SIZE);
+  uint8_t *p = mmap(NULL, CONFIG_MSIZE + align - PAGE_SIZE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  Assert(p != MAP_FAILED, "Can not reserve the address space for pmem");
+  // give back the address space out of the aligned part
+  pmem = (uint8_t *)ROUNDUP(p, align);
+  if (pmem > p) munmap(p, pmem - p);
+  if (align > PAGE_SIZE + (pmem - p)) {
+    munmap(pmem + CONFIG_MSIZE, align - PAGE_SIZE - (pmem - p));
+  }
+#endif
+  // an unaligned pmem only gets huge pages in the aligned part
+  IFDEF(CONFIG_PMEM_HUGEPAGE, pmem_advise_hugepage(pmem, pmem + CONFIG_MSIZE));
+#if defined(CONFIG_MEM_RANDOM_LAZY)
+  init_mem_lazy();
+#elif defined(CONFIG_MEM_RANDOM)
+  memset(pmem, rand(), CONFIG_MSIZE);
 #endif
-  IFDEF(CONFIG_MEM_RANDOM, memset(pmem, rand(), CONFIG_MSIZE));
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
+  IFDEF(CONFIG_PMEM_HUGEPAGE, pmem_hugepage_report());
 }
 
-word_t paddr_read(paddr_t addr, int len) {
-  if (likely(in_pmem(addr))) return pmem_read(addr, len);
-  IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
+word_t paddr_read_slow(paddr_t addr, int len) {
+#ifdef CONFIG_DEVICE
+  MMIORam *r = mmio_ram_find(addr, len);
+  if (r != NULL) return mmio_ram_read(r, addr, len);
+  return mmio_read(addr, len);
+#endif
   out_of_bound(addr);
   return 0;
 }
 
+void paddr_write_slow(paddr_t addr, int len, word_t data) {
+#ifdef CONFIG_DEVICE
+  MMIORam *r = mmio_ram_find(addr, len);
+  if (r != NULL) { mmio_ram_write(r, addr, len, data); return; }
+  mmio_write(addr, len, data);
+  return;
+#endif
+  out_of_bound(addr);
+}
+
+static word_t amo_calc(int op, word_t old, word_t src, int len) {
+  int shift = (sizeof(word_t) - len) * 8; // compare the lower `len' bytes only
+  switch (op) {
+    case AMO_SWAP: return src;
+    case AMO_ADD:  return old + src;
+    case AMO_XOR:  return old ^ src;
+    case AMO_AND:  return old & src;
+    case AMO_OR:   return old | src;
+    case AMO_MIN:  return (sword_t)(old << shift) < (sword_t)(src << shift) ? old : src;
+    case AMO_MAX:  return (sword_t)(old << shift) > (sword_t)(src << shift) ? old : src;
+    case AMO_MINU: return (old << shift) < (src << shift) ? old : src;
+    case AMO_MAXU: return (old << shift) > (src << shift) ? old : src;
+    default: panic("unsupported amo op = %d", op);
+  }
+}
+
+#define def_pmem_amo(type) \
+static word_t concat(pmem_amo_, type)(type *p, int op, word_t src) { \
+  type old = __atomic_load_n(p, __ATOMIC_RELAXED), new; \
+  do { \
+    new = amo_calc(op, old, src, sizeof(type)); \
+  } while (!__atomic_compare_exchange_n(p, &old, new, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)); \
+  return old; \
+}
+
+def_pmem_amo(uint32_t)
+IFDEF(CONFIG_ISA64, def_pmem_amo(uint64_t))
+
+word_t paddr_amo(paddr_t addr, int len, int op, word_t src) {
+  Assert(in_pmem(addr) && addr % len == 0,
+      "atomic access to " FMT_PADDR " is not an aligned pmem access at pc = " FMT_WORD, addr, cpu.pc);
+  IFDEF(CONFIG_DECODE_CACHE, pmem_check_code(addr, len));
+  switch (len) {
+    case 4: return pmem_amo_uint32_t((uint32_t *)guest_to_host(addr), op, src);
+    IFDEF(CONFIG_ISA64, case 8: return pmem_amo_uint64_t((uint64_t *)guest_to_host(addr), op, src));
+    default: panic("unsupported amo len = %d", len);
+  }
+}
+
+bool paddr_cas(paddr_t addr, int len, word_t expected, word_t data) {
+  Assert(in_pmem(addr) && addr % len == 0,
+      "atomic access to " FMT_PADDR " is not an aligned pmem access at pc = " FMT_WORD, addr, cpu.pc);
+  bool ok;
+  switch (len) {
+    case 4: {
+      uint32_t old = expected;
+      ok = __atomic_compare_exchange_n((uint32_t *)guest_to_host(addr), &old, data,
+          false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      break;
+    }
+#ifdef CONFIG_ISA64
+    case 8: {
+      uint64_t old = expected;
+      ok = __atomic_compare_exchange_n((uint64_t *)guest_to_host(addr), &old, data,
+          false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      break;
+    }
+#endif
+    default: panic("unsupported cas len = %d", len);
+  }
+  IFDEF(CONFIG_DECODE_CACHE, if (ok) pmem_check_code(addr, len));
+  return ok;
+}
+
+word_t paddr_read(paddr_t addr, int len) {
+  if (likely(in_pmem(addr))) return pmem_read(addr, len);
+  return paddr_read_slow(addr, len);
+}
+
 void paddr_write(paddr_t addr, int len, word_t data) {
   if (likely(in_pmem(addr))) { pmem_write(addr, len, data); return; }
-  IFDEF(CONFIG_DEVICE, mmio_write(addr, len, data); return);
-  out_of_bound(addr);
+  paddr_write_slow(addr, len, data);
 }
@@ -15,15 +15,33 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/vaddr.h>
 
-word_t vaddr_ifetch(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+// the physical address of `addr', which isa_mmu_check() says needs translation
+static paddr_t vaddr_translate(vaddr_t addr, int len, int type) {
+  paddr_t pg_base = isa_mmu_translate(addr, len, type);
+  Assert((pg_base & PAGE_MASK) == MEM_RET_OK,
+      "address translation of " FMT_WORD " fails", (word_t)addr);
+  return pg_base | (addr & PAGE_MASK);
 }
 
-word_t vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+word_t vaddr_mmu_read(vaddr_t addr, int len, int type) {
+  return paddr_read(vaddr_translate(addr, len, type), len);
 }
 
-void vaddr_write(vaddr_t addr, int len, word_t data) {
-  paddr_write(addr, len, data);
+void vaddr_mmu_write(vaddr_t addr, int len, word_t data) {
+  paddr_write(vaddr_translate(addr, len, MEM_TYPE_WRITE), len, data);
+}
+
+static paddr_t vaddr_to_paddr(vaddr_t addr, int len) {
+  if (isa_mmu_check(addr, len, MEM_TYPE_WRITE) == MMU_DIRECT) return addr;
+  return vaddr_translate(addr, len, MEM_TYPE_WRITE);
+}
+
+word_t vaddr_amo(vaddr_t addr, int len, int op, word_t src) {
+  return paddr_amo(vaddr_to_paddr(addr, len), len, op, src);
+}
+
+bool vaddr_cas(vaddr_t addr, int len, word_t expected, word_t data) {
+  return paddr_cas(vaddr_to_paddr(addr, len), len, expected, data);
 }
@@ -0,0 +1,204 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <memory/paddr.h>
+#include <cpu/difftest.h>
+#include <stddef.h>
+
+/* A checkpoint holds the header, the CPU state, the device registers in
+ * io_space, then pmem as runs of pages. Each run starts with its first
+ * page, the number of pages and its kind, and a run of 0 page ends the
+ * file. The pages of a data run follow it. A random run has no data: its
+ * pages are never accessed with CONFIG_MEM_RANDOM_LAZY, and get random
+ * contents again when loaded. Pages in no run are zero. Pages in pmem are
+ * written and read in place without extra copies.
+ */
+
+#define CKPT_MAGIC "NEMUCKPT"
+#define CKPT_VERSION 2
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t cpu_size;
+  char isa[16];
+  uint64_t mbase;
+  uint64_t msize;
+  uint64_t io_size;
+  uint64_t nr_guest_inst;
+} CkptHeader;
+
+enum { CKPT_ZERO, CKPT_DATA, CKPT_RANDOM };
+
+typedef struct {
+  uint32_t page;
+  uint32_t nr_page;
+  uint32_t kind;
+} CkptRun;
+
+#define NR_PAGE (CONFIG_MSIZE / PAGE_SIZE)
+
+extern uint64_t g_nr_guest_inst;
+extern uint64_t g_nr_guest_inst_base;
+uint8_t *io_space_used(size_t *size);
+void mmio_ram_mark_dirty();
+
+static void ckpt_header(CkptHeader *h) {
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, CKPT_MAGIC, sizeof(h->magic));
+  h->version = CKPT_VERSION;
+  h->cpu_size = sizeof(CPU_state);
+  strncpy(h->isa, str(__GUEST_ISA__), sizeof(h->isa) - 1);
+  h->mbase = CONFIG_MBASE;
+  h->msize = CONFIG_MSIZE;
+#ifdef CONFIG_DEVICE
+  size_t io_size;
+  io_space_used(&io_size);
+  h->io_size = io_size;
+#endif
+}
+
+static bool page_is_zero(uint32_t page) {
+  const uint64_t *p = (uint64_t *)(pmem + page * PAGE_SIZE);
+  for (int i = 0; i < PAGE_SIZE / sizeof(uint64_t); i ++) {
+    if (p[i] != 0) return false;
+  }
+  return true;
+}
+
+static int page_kind(uint32_t page) {
+#ifdef CONFIG_MEM_RANDOM_LAZY
+  // reading an inaccessible page would initialize it
+  if (!pmem_page_touched(CONFIG_MBASE + page * PAGE_SIZE)) return CKPT_RANDOM;
+#endif
+  return page_is_zero(page) ? CKPT_ZERO : CKPT_DATA;
+}
+
+bool checkpoint_save(const char *file) {
+#ifdef CONFIG_MULTI_HART
+  printf("Checkpoints of multiple harts are not supported\n");
+  return false;
+#endif
+  FILE *fp = fopen(file, "wb");
+  if (fp == NULL) {
+    printf("Can not open '%s'\n", file);
+    return false;
+  }
+
+  CkptHeader h;
+  ckpt_header(&h);
+  h.nr_guest_inst = g_nr_guest_inst;
+  bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+  ok = ok && fwrite(&cpu, sizeof(cpu), 1, fp) == 1;
+#ifdef CONFIG_DEVICE
+  size_t io_size;
+  uint8_t *io = io_space_used(&io_size);
+  ok = ok && fwrite(io, io_size, 1, fp) == 1;
+#endif
+
+  uint32_t nr_saved = 0;
+  for (uint32_t page = 0; ok && page < NR_PAGE; ) {
+    CkptRun run = { .page = page, .nr_page = 0, .kind = page_kind(page) };
+    do { page ++; run.nr_page ++; } while (page < NR_PAGE && page_kind(page) == run.kind);
+    if (run.kind == CKPT_ZERO) continue;
+    ok = fwrite(&run, sizeof(run), 1, fp) == 1;
+    if (run.kind == CKPT_DATA) {
+      ok = ok && fwrite(pmem + run.page * PAGE_SIZE, run.nr_page * PAGE_SIZE, 1, fp) == 1;
+      nr_saved += run.nr_page;
+    }
+  }
+  CkptRun end = { .page = 0, .nr_page = 0, .kind = CKPT_ZERO };
+  ok = ok && fwrite(&end, sizeof(end), 1, fp) == 1;
+  ok = (fclose(fp) == 0) && ok;
+
+  if (!ok) {
+    printf("Can not write checkpoint '%s'\n", file);
+    return false;
+  }
+  Log("Checkpoint saved to %s, %u/%u pages, %" PRIu64 " instructions",
+      file, nr_saved, (uint32_t)NR_PAGE, g_nr_guest_inst);
+  return true;
+}
+
+bool checkpoint_load(const char *file) {
+#ifdef CONFIG_MULTI_HART
+  printf("Checkpoints of multiple harts are not supported\n");
+  return false;
+#endif
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) {
+    printf("Can not open '%s'\n", file);
+    return false;
+  }
+
+  CkptHeader h, expect;
+  ckpt_header(&expect);
+  if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(&h, &expect, offsetof(CkptHeader, nr_guest_inst)) != 0) {
+    printf("'%s' is not a checkpoint of this NEMU\n", file);
+    fclose(fp);
+    return false;
+  }
+
+  bool ok = fread(&cpu, sizeof(cpu), 1, fp) == 1;
+#ifdef CONFIG_DEVICE
+  size_t io_size;
+  uint8_t *io = io_space_used(&io_size);
+  ok = ok && fread(io, io_size, 1, fp) == 1;
+  mmio_ram_mark_dirty();
+#endif
+
+  // pages not in the checkpoint are zero, and cost no host memory if possible
+  uint32_t next = 0;
+  CkptRun run;
+  while (ok && (ok = fread(&run, sizeof(run), 1, fp) == 1) && run.nr_page != 0) {
+    ok = run.page >= next && run.nr_page <= NR_PAGE - run.page;
+    if (!ok) break;
+    pmem_clear(CONFIG_MBASE + next * PAGE_SIZE, (run.page - next) * PAGE_SIZE);
+    if (run.kind == CKPT_RANDOM) {
+      pmem_randomize(CONFIG_MBASE + run.page * PAGE_SIZE, run.nr_page * PAGE_SIZE);
+    } else {
+      ok = run.kind == CKPT_DATA;
+      if (!ok) break;
+      IFDEF(CONFIG_MEM_RANDOM_LAZY, pmem_prepare_write(CONFIG_MBASE + run.page * PAGE_SIZE,
+            run.nr_page * PAGE_SIZE));
+      ok = fread(pmem + run.page * PAGE_SIZE, run.nr_page * PAGE_SIZE, 1, fp) == 1;
+    }
+    next = run.page + run.nr_page;
+  }
+  fclose(fp);
+  if (!ok) {
+    // the machine is left in a mixed state
+    panic("checkpoint '%s' is broken", file);
+  }
+  pmem_clear(CONFIG_MBASE + next * PAGE_SIZE, (NR_PAGE - next) * PAGE_SIZE);
+
+#ifdef CONFIG_DECODE_CACHE
+  // drop the translation of code pages
+  for (uint32_t page = 0; page < NR_PAGE; page ++) {
+    if (pmem_code_page[page]) pmem_code_written(CONFIG_MBASE + page * PAGE_SIZE);
+  }
+#endif
+#ifdef CONFIG_DIFFTEST
+  ref_difftest_memcpy(CONFIG_MBASE, pmem, CONFIG_MSIZE, DIFFTEST_TO_REF);
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+#endif
+
+  g_nr_guest_inst = h.nr_guest_inst;
+  g_nr_guest_inst_base = h.nr_guest_inst;
+  nemu_state.state = NEMU_STOP;
+  Log("Checkpoint loaded from %s, %" PRIu64 " instructions", file, g_nr_guest_inst);
+  return true;
+}
@@ -0,0 +1,179 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* nemu-farm: run every task, e.g. an image in a list, in its own process.
+ * The processes are forked after the monitor is initialized, so they
+ * share the setup of NEMU and start from the same state. At most one
+ * process per host core is running at the same time.
+ */
+
+typedef struct {
+  bool done; // set by the process at exit
+  NEMUState state;
+  uint64_t nr_inst; // executed by the process
+  uint64_t time_us;
+} FarmResult;
+
+extern uint64_t g_nr_guest_inst;
+extern uint64_t g_nr_guest_inst_base;
+extern uint64_t g_timer;
+extern FILE *log_fp;
+void init_alarm();
+
+static FarmResult *result = NULL; // shared by all processes
+static int farm_idx = -1;
+
+static void farm_report() {
+  FarmResult *r = &result[farm_idx];
+  r->state = nemu_state;
+  r->nr_inst = g_nr_guest_inst - g_nr_guest_inst_base;
+  r->time_us = g_timer;
+  r->done = true;
+}
+
+static char **read_list(const char *list, int *nr_img) {
+  FILE *fp = fopen(list, "r");
+  Assert(fp, "Can not open '%s'", list);
+  char **img = NULL;
+  int n = 0, size = 0;
+  char *line = NULL;
+  size_t len = 0;
+  while (getline(&line, &len, fp) != -1) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') continue;
+    if (n == size) {
+      size = (size == 0 ? 64 : size * 2);
+      img = realloc(img, sizeof(char *) * size);
+      assert(img);
+    }
+    img[n ++] = strdup(line);
+  }
+  free(line);
+  fclose(fp);
+  *nr_img = n;
+  return img;
+}
+
+static const char *result_str(FarmResult *r) {
+  if (!r->done) return "CRASH";
+  switch (r->state.state) {
+    case NEMU_END: return (r->state.halt_ret == 0 ? "GOOD TRAP" : "BAD TRAP");
+    case NEMU_ABORT: return "ABORT";
+    case NEMU_QUIT: return "QUIT";
+    default: return "STOP";
+  }
+}
+
+// the same as is_exit_status_bad()
+static bool result_good(FarmResult *r) {
+  return r->done && ((r->state.state == NEMU_END && r->state.halt_ret == 0) ||
+      r->state.state == NEMU_QUIT);
+}
+
+/* Print the result of each task, return the number of good ones. */
+int farm_summary(const char *what, char **name, int nr_task) {
+  int nr_good = 0;
+  printf("%-48s %-10s %18s %14s %10s\n", what, "result", "instructions", "host time(us)", "MIPS");
+  for (int i = 0; i < nr_task; i ++) {
+    FarmResult *r = &result[i];
+    if (result_good(r)) nr_good ++;
+    printf("%-48s %-10s %18" PRIu64 " %14" PRIu64 " %10" PRIu64 "\n", name[i], result_str(r),
+        r->nr_inst, r->time_us, (r->time_us > 0 ? r->nr_inst / r->time_us : 0));
+  }
+  Log("nemu-farm: %d/%d good", nr_good, nr_task);
+  return nr_good;
+}
+
+static void farm_child(int idx, const char *out) {
+  farm_idx = idx;
+
+  // the output of each process goes to its own file through stdout,
+  // which Log() already prints to
+  FILE *fp = freopen(out ? out : "/dev/null", "w", stdout);
+  Assert(fp, "Can not open '%s'", out);
+  dup2(fileno(stdout), STDERR_FILENO);
+  log_fp = NULL;
+
+  // interval timers are not inherited by fork()
+  IFDEF(CONFIG_DEVICE, init_alarm());
+  atexit(farm_report);
+}
+
+/* Fork a process for each of the `nr_task' tasks, with the output of
+ * task i going to out[i], or discarded if `out' is NULL. In the forked
+ * process, this returns the index of its task and the monitor goes on
+ * as usual. The parent returns -1 after all of them exit.
+ */
+int farm_run(int nr_task, char **out) {
+  int nr_job = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nr_job < 1) nr_job = 1;
+  Log("nemu-farm: %d tasks, %d jobs", nr_task, nr_job);
+
+  result = mmap(NULL, sizeof(FarmResult) * (nr_task + 1), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  Assert(result != MAP_FAILED, "Can not allocate the results");
+
+  int next = 0, running = 0;
+  while (next < nr_task || running > 0) {
+    if (next < nr_task && running < nr_job) {
+      fflush(NULL);
+      pid_t p = fork();
+      Assert(p >= 0, "Can not fork for task %d", next);
+      if (p == 0) {
+        farm_child(next, out ? out[next] : NULL);
+        return next;
+      }
+      next ++;
+      running ++;
+      continue;
+    }
+    pid_t p = wait(NULL);
+    assert(p > 0);
+    running --;
+  }
+  return -1;
+}
+
+/* Run the images in `list'. In each forked process, this returns the
+ * path of its image. The parent prints the summary and exits.
+ */
+char *farm_start(const char *list, const char *log_file) {
+  int nr_img = 0;
+  char **img = read_list(list, &nr_img);
+  Log("nemu-farm: %d images from %s", nr_img, list);
+
+  char **out = NULL;
+  if (log_file != NULL) {
+    out = malloc(sizeof(char *) * nr_img);
+    assert(out);
+    for (int i = 0; i < nr_img; i ++) {
+      out[i] = malloc(PATH_MAX);
+      assert(out[i]);
+      snprintf(out[i], PATH_MAX, "%s.%d", log_file, i);
+    }
+  }
+
+  int idx = farm_run(nr_img, out);
+  if (idx >= 0) return img[idx];
+
+  int nr_good = farm_summary("image", img, nr_img);
+  exit(nr_good == nr_img ? 0 : 1);
+}
@@ -40,12 +40,39 @@ static void welcome() {
 #include <getopt.h>
 
 void sdb_set_batch_mode();
+void sdb_set_batch_stop(uint64_t nr_inst, char *ckpt);
+bool checkpoint_load(const char *file);
+char *farm_start(const char *list, const char *log_file);
+void sample_set(char *dir, uint64_t interval);
+char *sample_replay(const char *list);
 
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
+static char *elf_file = NULL;
+static char *farm_list = NULL;
+static char *ckpt_load = NULL;
+static char *ckpt_save = NULL;
+static uint64_t ckpt_save_at = 0;
+static char *sample_dir = NULL;
+static uint64_t sample_interval = 0;
+static char *replay_list = NULL;
 static int difftest_port = 1234;
 
+#ifdef CONFIG_IMG_MMAP
+#include <sys/mman.h>
+
+// map the image to the reset vector as a private copy
+static bool map_img(FILE *fp, long size) {
+  uint8_t *p = guest_to_host(RESET_VECTOR);
+  if ((uintptr_t)p % PAGE_SIZE != 0 || size == 0) return false;
+  Assert(size <= CONFIG_MSIZE - CONFIG_PC_RESET_OFFSET, "The image is larger than the memory");
+  if (mmap(p, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fileno(fp), 0) != p) return false;
+  IFDEF(CONFIG_MEM_RANDOM_LAZY, pmem_prepare_write(RESET_VECTOR, ROUNDUP(size, PAGE_SIZE)));
+  return true;
+}
+#endif
+
 static long load_img() {
   if (img_file == NULL) {
     Log("No image is given. Use the default build-in image.");
@@ -60,7 +87,15 @@ static long load_img() {
 
   Log("The image is %s, size = %ld", img_file, size);
 
+#ifdef CONFIG_IMG_MMAP
+  if (map_img(fp, size)) {
+    fclose(fp);
+    return size;
+  }
+#endif
+
   fseek(fp, 0, SEEK_SET);
+  IFDEF(CONFIG_MEM_RANDOM_LAZY, pmem_prepare_write(RESET_VECTOR, size));
   int ret = fread(guest_to_host(RESET_VECTOR), size, 1, fp);
   assert(ret == 1);
 
@@ -74,16 +109,38 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"elf"      , required_argument, NULL, 'e'},
+    {"flame"    , required_argument, NULL, 'F'},
+    {"mix"      , required_argument, NULL, 'M'},
+    {"stats"    , required_argument, NULL, 's'},
+    {"farm"     , required_argument, NULL, 'f'},
+    {"load"     , required_argument, NULL, 'L'},
+    {"save"     , required_argument, NULL, 'S'},
+    {"save-at"  , required_argument, NULL, 'N'},
+    {"sample-dir", required_argument, NULL, 'D'},
+    {"sample-interval", required_argument, NULL, 'I'},
+    {"replay"   , required_argument, NULL, 'R'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhl:d:p:e:F:M:s:f:L:S:N:D:I:R:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'e': elf_file = optarg; break;
+      case 'F': IFDEF(CONFIG_PC_SAMPLE, psample_set_file(optarg)); break;
+      case 'M': IFDEF(CONFIG_INST_MIX, imix_set_file(optarg)); break;
+      case 's': stats_set_file(optarg); break;
+      case 'f': farm_list = optarg; sdb_set_batch_mode(); break;
+      case 'L': ckpt_load = optarg; break;
+      case 'S': ckpt_save = optarg; sdb_set_batch_mode(); break;
+      case 'N': sscanf(optarg, "%" SCNu64, &ckpt_save_at); break;
+      case 'D': sample_dir = optarg; break;
+      case 'I': sscanf(optarg, "%" SCNu64, &sample_interval); sdb_set_batch_mode(); break;
+      case 'R': replay_list = optarg; sdb_set_batch_mode(); break;
       case 1: img_file = optarg; return 0;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -91,6 +148,17 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-e,--elf=FILE           read the symbols of the guest from ELF FILE\n");
+        printf("\t-F,--flame=FILE         write the stacks sampled by the profiler to FILE\n");
+        printf("\t-M,--mix=FILE           write the instruction mix as JSON to FILE\n");
+        printf("\t-s,--stats=FILE         write the performance statistics as JSON to FILE\n");
+        printf("\t-f,--farm=LIST          run the images listed in LIST in parallel, with batch mode\n");
+        printf("\t-L,--load=CKPT          restore the machine from checkpoint CKPT\n");
+        printf("\t-S,--save=CKPT          run with batch mode, save checkpoint CKPT and quit\n");
+        printf("\t-N,--save-at=N          save the checkpoint after N guest instructions (default 0)\n");
+        printf("\t-D,--sample-dir=DIR     keep the checkpoints of sampled simulation in DIR\n");
+        printf("\t-I,--sample-interval=N  run with batch mode, save a checkpoint every N instructions\n");
+        printf("\t-R,--replay=LIST        replay the intervals in LIST (e.g. 1,5,9) in parallel with tracing\n");
         printf("\n");
         exit(0);
     }
@@ -119,14 +187,31 @@ void init_monitor(int argc, char *argv[]) {
   /* Perform ISA dependent initialization. */
   init_isa();
 
+  /* With nemu-farm, every image is run in a forked process from here. */
+  if (farm_list != NULL) { img_file = farm_start(farm_list, log_file); }
+
+  /* Sampled simulation, every interval is replayed in a forked process. */
+  if (sample_dir != NULL) { sample_set(sample_dir, sample_interval); }
+  if (replay_list != NULL) { ckpt_load = sample_replay(replay_list); }
+
   /* Load the image to memory. This will overwrite the built-in image. */
   long img_size = load_img();
 
+  /* Read the guest symbols. */
+  if (elf_file != NULL) { init_elf(elf_file); }
+
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
+  /* Restore the machine from a checkpoint. */
+  if (ckpt_load != NULL) {
+    bool ok = checkpoint_load(ckpt_load);
+    Assert(ok, "Can not load checkpoint '%s'", ckpt_load);
+  }
+
   /* Initialize the simple debugger. */
   init_sdb();
+  if (ckpt_save != NULL) { sdb_set_batch_stop(ckpt_save_at, ckpt_save); }
 
   IFDEF(CONFIG_ITRACE, init_disasm());
 
@@ -0,0 +1,153 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/cpu.h>
+#include <limits.h>
+
+/* Sampled simulation.
+ *
+ * Fast-forward: run the guest without tracing, profiling or difftest, and
+ * save a checkpoint at the start of every interval of N instructions. The
+ * checkpoints are indexed in DIR/index, with a line "<interval> <start
+ * instruction> <checkpoint>" for each of them.
+ *
+ * Replay: restore the checkpoint of each selected interval in its own
+ * process, and run the interval with the trace window, which turns the
+ * instruction trace and Log() on, set to it. The output and the trace of
+ * interval i go to DIR/interval-i.{out,log}.
+ */
+
+extern uint64_t g_nr_guest_inst;
+extern FILE *log_fp;
+bool checkpoint_save(const char *file);
+void sdb_set_batch_stop(uint64_t nr_inst, char *ckpt);
+void log_set_window(uint64_t start, uint64_t end);
+int farm_run(int nr_task, char **out);
+int farm_summary(const char *what, char **name, int nr_task);
+
+static char *sample_dir = NULL;
+static uint64_t sample_interval = 0;
+
+void sample_set(char *dir, uint64_t interval) {
+  sample_dir = dir;
+  sample_interval = interval;
+}
+
+static char *sample_path(const char *fmt, uint64_t idx) {
+  char name[64];
+  snprintf(name, sizeof(name), fmt, idx);
+  char *path = malloc(PATH_MAX);
+  assert(path);
+  snprintf(path, PATH_MAX, "%s/%s", sample_dir, name);
+  return path;
+}
+
+// called by sdb in batch mode, return false if not fast-forwarding
+bool sample_fast_forward() {
+  if (sample_dir == NULL || sample_interval == 0) return false;
+
+  char *index = sample_path("index", 0);
+  FILE *fp = fopen(index, "w");
+  Assert(fp, "Can not open '%s'", index);
+  fprintf(fp, "interval %" PRIu64 "\n", sample_interval);
+
+  IFDEF(CONFIG_TRACE, log_set_window(-1, 0)); // no tracing
+  cpu_set_fast_forward(true);
+  int nr_ckpt = 0;
+  while (true) {
+    if (g_nr_guest_inst % sample_interval == 0) {
+      uint64_t idx = g_nr_guest_inst / sample_interval;
+      char *ckpt = sample_path("ckpt-%" PRIu64 ".bin", idx);
+      bool ok = checkpoint_save(ckpt);
+      Assert(ok, "Can not save checkpoint '%s'", ckpt);
+      fprintf(fp, "%" PRIu64 " %" PRIu64 " %s\n", idx, g_nr_guest_inst, ckpt);
+      fflush(fp);
+      free(ckpt);
+      nr_ckpt ++;
+    }
+    uint64_t next = (g_nr_guest_inst / sample_interval + 1) * sample_interval;
+    cpu_exec(next - g_nr_guest_inst);
+    if (nemu_state.state != NEMU_STOP) break;
+  }
+
+  cpu_set_fast_forward(false);
+  fclose(fp);
+  Log("Sampling: %d checkpoints every %" PRIu64 " instructions are indexed in %s",
+      nr_ckpt, sample_interval, index);
+  free(index);
+  return true;
+}
+
+/* Replay the intervals in `list', separated by commas. In each forked
+ * process, this returns the checkpoint to restore. The parent prints
+ * the summary and exits.
+ */
+char *sample_replay(const char *list) {
+  Assert(sample_dir != NULL, "The directory of sampling is not given");
+  char *index = sample_path("index", 0);
+  FILE *fp = fopen(index, "r");
+  Assert(fp, "Can not open '%s'", index);
+  uint64_t interval = 0;
+  int ret = fscanf(fp, "interval %" SCNu64 "\n", &interval);
+  Assert(ret == 1 && interval > 0, "'%s' is broken", index);
+
+  int nr = 0;
+  for (const char *p = list; *p != '\0'; p ++) { if (*p == ',') nr ++; }
+  nr ++;
+  uint64_t *sel = malloc(sizeof(uint64_t) * nr);
+  char **name = malloc(sizeof(char *) * nr);
+  char **out = malloc(sizeof(char *) * nr);
+  assert(sel && name && out);
+  const char *p = list;
+  for (int i = 0; i < nr; i ++) {
+    char *end;
+    sel[i] = strtoull(p, &end, 0);
+    Assert(end != p && (*end == ',' || *end == '\0'), "Bad list of intervals '%s'", list);
+    p = end + 1;
+    name[i] = malloc(32);
+    assert(name[i]);
+    snprintf(name[i], 32, "%" PRIu64, sel[i]);
+    out[i] = sample_path("interval-%" PRIu64 ".out", sel[i]);
+  }
+
+  // look up the checkpoints of the selected intervals
+  char **ckpt = calloc(nr, sizeof(char *));
+  assert(ckpt);
+  uint64_t idx, start;
+  char path[PATH_MAX];
+  while (fscanf(fp, "%" SCNu64 " %" SCNu64 " %4095s\n", &idx, &start, path) == 3) {
+    for (int i = 0; i < nr; i ++) {
+      if (sel[i] == idx) { ckpt[i] = strdup(path); }
+    }
+  }
+  fclose(fp);
+  for (int i = 0; i < nr; i ++) {
+    Assert(ckpt[i] != NULL, "Interval %" PRIu64 " is not in '%s'", sel[i], index);
+  }
+
+  int k = farm_run(nr, out);
+  if (k >= 0) {
+    char *log = sample_path("interval-%" PRIu64 ".log", sel[k]);
+    log_fp = fopen(log, "w");
+    Assert(log_fp, "Can not open '%s'", log);
+    start = sel[k] * interval;
+    IFDEF(CONFIG_TRACE, log_set_window(start, start + interval));
+    sdb_set_batch_stop(start + interval, NULL);
+    return ckpt[k];
+  }
+
+  int nr_good = farm_summary("interval", name, nr);
+  exit(nr_good == nr ? 0 : 1);
+}
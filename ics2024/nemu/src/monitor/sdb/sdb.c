@@ -20,9 +20,15 @@
 #include "sdb.h"
 
 static int is_batch_mode = false;
+static bool batch_stop = false;
+static uint64_t batch_stop_at = 0;
+static char *batch_ckpt = NULL;
 
 void init_regex();
 void init_wp_pool();
+bool checkpoint_save(const char *file);
+bool checkpoint_load(const char *file);
+bool sample_fast_forward();
 
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 static char* rl_gets() {
@@ -52,6 +58,20 @@ static int cmd_q(char *args) {
   return -1;
 }
 
+static int cmd_save(char *args) {
+  char *file = strtok(NULL, " ");
+  if (file == NULL) { printf("Usage: save FILE\n"); return 0; }
+  checkpoint_save(file);
+  return 0;
+}
+
+static int cmd_load(char *args) {
+  char *file = strtok(NULL, " ");
+  if (file == NULL) { printf("Usage: load FILE\n"); return 0; }
+  checkpoint_load(file);
+  return 0;
+}
+
 static int cmd_help(char *args);
 
 static struct {
@@ -62,6 +82,8 @@ static struct {
   { "help", "Display information about all supported commands", cmd_help },
   { "c", "Continue the execution of the program", cmd_c },
   { "q", "Exit NEMU", cmd_q },
+  { "save", "Save the machine to a checkpoint file", cmd_save },
+  { "load", "Restore the machine from a checkpoint file", cmd_load },
 
   /* TODO: Add more commands */
 
@@ -96,8 +118,25 @@ void sdb_set_batch_mode() {
   is_batch_mode = true;
 }
 
+// in batch mode, stop after `nr_inst' instructions in total,
+// save a checkpoint to `ckpt' if it is not NULL, and quit
+void sdb_set_batch_stop(uint64_t nr_inst, char *ckpt) {
+  batch_stop = true;
+  batch_stop_at = nr_inst;
+  batch_ckpt = ckpt;
+}
+
 void sdb_mainloop() {
   if (is_batch_mode) {
+    if (batch_stop) {
+      extern uint64_t g_nr_guest_inst;
+      if (batch_stop_at > g_nr_guest_inst) { cpu_exec(batch_stop_at - g_nr_guest_inst); }
+      if (nemu_state.state == NEMU_STOP && (batch_ckpt == NULL || checkpoint_save(batch_ckpt))) {
+        nemu_state.state = NEMU_QUIT;
+      }
+      return;
+    }
+    if (sample_fast_forward()) { return; }
     cmd_c(NULL);
     return;
   }
@@ -0,0 +1,95 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <elf.h>
+
+ElfFunc *elf_func = NULL;
+int elf_nr_func = 0;
+
+static int func_cmp(const void *a, const void *b) {
+  const ElfFunc *x = a, *y = b;
+  if (x->start != y->start) return x->start < y->start ? -1 : 1;
+  // the larger one of the aliases goes first
+  return x->end > y->end ? -1 : (x->end < y->end);
+}
+
+// collect the defined functions in every symbol table of the ELF file in `buf'
+#define LOAD_FUNC(Ehdr, Shdr, Sym, ST_TYPE) do { \
+  Ehdr *eh = (Ehdr *)buf; \
+  Assert(eh->e_shoff + eh->e_shnum * sizeof(Shdr) <= size, "Broken ELF file '%s'", elf_file); \
+  Shdr *sh = (Shdr *)(buf + eh->e_shoff); \
+  for (int i = 0; i < eh->e_shnum; i ++) { \
+    if (sh[i].sh_type != SHT_SYMTAB) continue; \
+    Sym *sym = (Sym *)(buf + sh[i].sh_offset); \
+    char *strtab = (char *)(buf + sh[sh[i].sh_link].sh_offset); \
+    int nr = sh[i].sh_size / sizeof(Sym); \
+    elf_func = realloc(elf_func, (elf_nr_func + nr) * sizeof(ElfFunc)); \
+    assert(elf_func); \
+    for (int j = 0; j < nr; j ++) { \
+      if (ST_TYPE(sym[j].st_info) != STT_FUNC || sym[j].st_shndx == SHN_UNDEF) continue; \
+      ElfFunc *f = &elf_func[elf_nr_func ++]; \
+      f->start = sym[j].st_value; \
+      f->end = sym[j].st_value + sym[j].st_size; \
+      f->name = strdup(strtab + sym[j].st_name); \
+    } \
+  } \
+} while (0)
+
+void init_elf(const char *elf_file) {
+  FILE *fp = fopen(elf_file, "rb");
+  Assert(fp, "Can not open '%s'", elf_file);
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *buf = malloc(size);
+  assert(buf);
+  int ret = fread(buf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Assert(size >= EI_NIDENT && memcmp(buf, ELFMAG, SELFMAG) == 0, "'%s' is not an ELF file", elf_file);
+  if (buf[EI_CLASS] == ELFCLASS64) LOAD_FUNC(Elf64_Ehdr, Elf64_Shdr, Elf64_Sym, ELF64_ST_TYPE);
+  else LOAD_FUNC(Elf32_Ehdr, Elf32_Shdr, Elf32_Sym, ELF32_ST_TYPE);
+  free(buf);
+
+  // sort by the start address, keep one of the aliases, and let a function
+  // without size extend to the next one
+  qsort(elf_func, elf_nr_func, sizeof(ElfFunc), func_cmp);
+  int nr = 0;
+  for (int i = 0; i < elf_nr_func; i ++) {
+    if (nr > 0 && elf_func[nr - 1].start == elf_func[i].start) { free(elf_func[i].name); continue; }
+    elf_func[nr ++] = elf_func[i];
+  }
+  elf_nr_func = nr;
+  for (int i = 0; i < nr; i ++) {
+    ElfFunc *f = &elf_func[i];
+    vaddr_t next = (i + 1 < nr ? elf_func[i + 1].start : f->start);
+    if (f->end <= f->start || (i + 1 < nr && f->end > next)) f->end = (next > f->start ? next : f->start + 1);
+  }
+  Log("Load %d functions from the ELF file %s", nr, elf_file);
+}
+
+int elf_func_find(vaddr_t addr) {
+  int lo = 0, hi = elf_nr_func - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (elf_func[mid].start <= addr) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  // hi is the last function starting at or below addr
+  return (hi >= 0 && addr < elf_func[hi].end) ? hi : -1;
+}
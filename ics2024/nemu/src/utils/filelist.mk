@@ -13,6 +13,26 @@
 # See the Mulan PSL v2 for more details.
 #**************************************************************************************/
 
+ifndef CONFIG_ITRACE
+SRCS-BLACKLIST-y += src/utils/itrace.c
+endif
+
+ifndef CONFIG_FUNC_PROFILE
+SRCS-BLACKLIST-y += src/utils/fprof.c
+endif
+
+ifndef CONFIG_PC_SAMPLE
+SRCS-BLACKLIST-y += src/utils/psample.c
+endif
+
+ifndef CONFIG_INST_MIX
+SRCS-BLACKLIST-y += src/utils/imix.c
+endif
+
+ifeq ($(CONFIG_PC_SAMPLE)$(CONFIG_INST_MIX),)
+SRCS-BLACKLIST-y += src/utils/hash.c
+endif
+
 ifeq ($(CONFIG_ITRACE)$(CONFIG_IQUEUE),)
 SRCS-BLACKLIST-y += src/utils/disasm.c
 else
@@ -0,0 +1,82 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <isa.h>
+
+typedef struct {
+  uint64_t nr_inst; // instructions executed inside the function
+  uint64_t nr_call; // times the function is called
+} FuncStat;
+
+// the last one is for the instructions outside any known function
+static FuncStat *fstat = NULL;
+static uint64_t nr_call_unknown = 0;
+
+// the function the previous instruction belongs to
+static vaddr_t cur_start = 0, cur_len = 0;
+static FuncStat *cur = NULL;
+
+static FuncStat *func_stat(vaddr_t pc, vaddr_t *start, vaddr_t *len) {
+  int idx = elf_func_find(pc);
+  if (idx < 0) { *start = pc; *len = 1; return &fstat[elf_nr_func]; }
+  *start = elf_func[idx].start;
+  *len = elf_func[idx].end - elf_func[idx].start;
+  return &fstat[idx];
+}
+
+void fprof_step(vaddr_t pc, vaddr_t dnpc, int jump_kind) {
+  if (unlikely(fstat == NULL)) {
+    fstat = calloc(elf_nr_func + 1, sizeof(FuncStat));
+    assert(fstat);
+  }
+  if (unlikely(pc - cur_start >= cur_len)) { cur = func_stat(pc, &cur_start, &cur_len); }
+  cur->nr_inst ++;
+  if (jump_kind == JUMP_CALL) {
+    int idx = elf_func_find(dnpc);
+    if (idx >= 0) fstat[idx].nr_call ++;
+    else nr_call_unknown ++;
+  }
+}
+
+static int stat_cmp(const void *a, const void *b) {
+  uint64_t x = fstat[*(int *)a].nr_inst, y = fstat[*(int *)b].nr_inst;
+  return x > y ? -1 : (x < y);
+}
+
+void fprof_report() {
+  extern FILE *log_fp;
+  if (fstat == NULL || elf_nr_func == 0) return;
+  int nr = elf_nr_func + 1;
+  int *order = malloc(sizeof(int) * nr);
+  assert(order);
+  uint64_t total = 0;
+  for (int i = 0; i < nr; i ++) { order[i] = i; total += fstat[i].nr_inst; }
+  qsort(order, nr, sizeof(int), stat_cmp);
+
+  log_report("Top guest functions by instructions executed:\n");
+  log_report("%-6s %16s %7s %12s  %s\n", "rank", "instructions", "%", "calls", "function");
+  for (int i = 0; i < nr && i < CONFIG_FUNC_PROFILE_TOP; i ++) {
+    FuncStat *f = &fstat[order[i]];
+    if (f->nr_inst == 0) break;
+    bool known = order[i] < elf_nr_func;
+    log_report("%-6d %16" PRIu64 " %6.2f%% %12" PRIu64 "  %s\n", i + 1, f->nr_inst,
+        100.0 * f->nr_inst / total, known ? f->nr_call : nr_call_unknown,
+        known ? elf_func[order[i]].name : "(unknown)");
+  }
+  if (log_fp != NULL) fflush(log_fp);
+  free(order);
+}
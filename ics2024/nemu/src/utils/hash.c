@@ -0,0 +1,56 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+
+static uint64_t hash_str(const char *s) {
+  uint64_t h = 14695981039346656037ull;
+  for (; *s; s ++) h = (h ^ (uint8_t)*s) * 1099511628211ull;
+  return h;
+}
+
+static HashEntry *hash_find(HashTable *t, uint64_t key, const char *str) {
+  uint32_t mask = t->size - 1;
+  uint32_t i = (key * 2654435761u) & mask;
+  for (HashEntry *e = &t->entry[i]; e->valid; e = &t->entry[i]) {
+    if (e->key == key && (str == NULL || strcmp(e->str, str) == 0)) return e;
+    i = (i + 1) & mask;
+  }
+  return &t->entry[i];
+}
+
+static void hash_grow(HashTable *t) {
+  HashEntry *old = t->entry;
+  int old_size = t->size;
+  t->size = (t->size == 0 ? 1024 : t->size * 2);
+  t->entry = calloc(t->size, sizeof(HashEntry));
+  assert(t->entry);
+  for (int i = 0; i < old_size; i ++) {
+    if (old[i].valid) *hash_find(t, old[i].key, old[i].str) = old[i];
+  }
+  free(old);
+}
+
+HashEntry *hash_get(HashTable *t, uint64_t key, const char *str) {
+  if (t->nr * 2 >= t->size) hash_grow(t);
+  if (str != NULL) key = hash_str(str);
+  HashEntry *e = hash_find(t, key, str);
+  if (!e->valid) {
+    *e = (HashEntry) { .key = key, .str = (str == NULL ? NULL : strdup(str)), .valid = true };
+    assert(str == NULL || e->str != NULL);
+    t->nr ++;
+  }
+  return e;
+}
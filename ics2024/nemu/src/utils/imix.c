@@ -0,0 +1,152 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <cpu/decode.h>
+
+InstPatCounter instpat_counter[INSTPAT_COUNTER_MAX] = {};
+uint64_t imix_nr_load = 0, imix_nr_store = 0;
+vaddr_t imix_block_start = 0;
+uint64_t imix_block_len = 0;
+
+static char *json_file = NULL;
+static uint64_t nr_jump = 0;
+
+typedef struct {
+  vaddr_t pc;
+  uint64_t count; // times the block is entered
+  uint64_t nr_inst;
+} BlockStat;
+
+// blocks by pc, with the counters of BlockStat in val[]
+static HashTable block = {};
+
+void imix_set_file(char *file) {
+  json_file = file;
+}
+
+static void block_add(vaddr_t pc, uint64_t count, uint64_t nr_inst) {
+  HashEntry *e = hash_get(&block, pc, NULL);
+  e->val[0] += count;
+  e->val[1] += nr_inst;
+}
+
+void imix_block_end() {
+  block_add(imix_block_start, 1, imix_block_len);
+  nr_jump ++;
+  imix_block_len = 0;
+}
+
+typedef struct {
+  const char *name;
+  uint64_t count;
+} PatStat;
+
+static int pat_cmp(const void *a, const void *b) {
+  uint64_t x = ((PatStat *)a)->count, y = ((PatStat *)b)->count;
+  return x > y ? -1 : (x < y);
+}
+
+static int block_cmp(const void *a, const void *b) {
+  uint64_t x = ((BlockStat *)a)->nr_inst, y = ((BlockStat *)b)->nr_inst;
+  return x > y ? -1 : (x < y);
+}
+
+// patterns of the same name, e.g. the forms of mov in x86, are merged
+static int pat_collect(PatStat *pat) {
+  int nr = 0;
+  for (int i = 0; i < INSTPAT_COUNTER_MAX; i ++) {
+    InstPatCounter *c = &instpat_counter[i];
+    if (c->count == 0) continue;
+    int k;
+    for (k = 0; k < nr && strcmp(pat[k].name, c->name) != 0; k ++) ;
+    if (k == nr) { pat[nr ++] = (PatStat) { c->name, 0 }; }
+    pat[k].count += c->count;
+  }
+  qsort(pat, nr, sizeof(PatStat), pat_cmp);
+  return nr;
+}
+
+static void block_func(vaddr_t pc, char *buf, int size) {
+  int idx = elf_func_find(pc);
+  if (idx < 0) snprintf(buf, size, "?");
+  else snprintf(buf, size, "%s+0x%x", elf_func[idx].name, (unsigned)(pc - elf_func[idx].start));
+}
+
+static void imix_write_json(PatStat *pat, int nr_pat, BlockStat *top, int nr_top, uint64_t total) {
+  FILE *fp = fopen(json_file, "w");
+  if (fp == NULL) { Log("Can not open '%s'", json_file); return; }
+  char func[128];
+  fprintf(fp, "{\n  \"instructions\": %" PRIu64 ",\n", total);
+  fprintf(fp, "  \"loads\": %" PRIu64 ",\n  \"stores\": %" PRIu64 ",\n  \"taken_jumps\": %" PRIu64 ",\n",
+      imix_nr_load, imix_nr_store, nr_jump);
+  fprintf(fp, "  \"patterns\": {");
+  for (int i = 0; i < nr_pat; i ++) {
+    fprintf(fp, "%s\n    \"%s\": %" PRIu64, (i == 0 ? "" : ","), pat[i].name, pat[i].count);
+  }
+  fprintf(fp, "\n  },\n  \"blocks\": [");
+  for (int i = 0; i < nr_top; i ++) {
+    block_func(top[i].pc, func, sizeof(func));
+    fprintf(fp, "%s\n    { \"pc\": \"" FMT_WORD "\", \"function\": \"%s\", \"count\": %" PRIu64
+        ", \"instructions\": %" PRIu64 " }", (i == 0 ? "" : ","), top[i].pc, func, top[i].count, top[i].nr_inst);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  fclose(fp);
+  Log("instruction mix is written to %s", json_file);
+}
+
+void imix_report() {
+  extern FILE *log_fp;
+  // count the block being executed
+  if (imix_block_len > 0) { block_add(imix_block_start, 1, imix_block_len); imix_block_len = 0; }
+  if (block.nr == 0) return;
+
+  static PatStat pat[INSTPAT_COUNTER_MAX];
+  int nr_pat = pat_collect(pat);
+  BlockStat *top = malloc(sizeof(BlockStat) * block.nr);
+  assert(top);
+  int nr = 0;
+  uint64_t total = 0;
+  for (int i = 0; i < block.size; i ++) {
+    HashEntry *e = &block.entry[i];
+    if (!e->valid) continue;
+    top[nr ++] = (BlockStat) { .pc = e->key, .count = e->val[0], .nr_inst = e->val[1] };
+    total += e->val[1];
+  }
+  qsort(top, nr, sizeof(BlockStat), block_cmp);
+  int nr_top = (nr < CONFIG_INST_MIX_TOP ? nr : CONFIG_INST_MIX_TOP);
+
+  log_report("Instruction mix:\n");
+  log_report("%-12s %16s %7s\n", "pattern", "count", "%");
+  for (int i = 0; i < nr_pat; i ++) {
+    log_report("%-12s %16" PRIu64 " %6.2f%%\n", pat[i].name, pat[i].count, 100.0 * pat[i].count / total);
+  }
+  log_report("loads = %.2f%%, stores = %.2f%%, taken jumps and branches = %.2f%% of %" PRIu64 " instructions\n",
+      100.0 * imix_nr_load / total, 100.0 * imix_nr_store / total, 100.0 * nr_jump / total, total);
+
+  char func[128];
+  log_report("Hot blocks:\n");
+  log_report("%-6s %-10s %12s %16s %7s  %s\n", "rank", "pc", "executions", "instructions", "%", "function");
+  for (int i = 0; i < nr_top; i ++) {
+    block_func(top[i].pc, func, sizeof(func));
+    log_report("%-6d " FMT_WORD " %12" PRIu64 " %16" PRIu64 " %6.2f%%  %s\n", i + 1, top[i].pc,
+        top[i].count, top[i].nr_inst, 100.0 * top[i].nr_inst / total, func);
+  }
+  if (log_fp != NULL) fflush(log_fp);
+
+  if (json_file != NULL) imix_write_json(pat, nr_pat, top, nr_top, total);
+  free(top);
+}
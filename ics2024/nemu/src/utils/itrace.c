@@ -0,0 +1,62 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+
+ItraceRecord itrace_buf[CONFIG_ITRACE_SIZE] = {};
+uint64_t itrace_nr = 0;
+
+static_assert((CONFIG_ITRACE_SIZE & (CONFIG_ITRACE_SIZE - 1)) == 0,
+    "CONFIG_ITRACE_SIZE should be a power of 2");
+
+void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
+
+void itrace_format(char *buf, int size, vaddr_t pc, const uint8_t *inst, int len) {
+  char *p = buf;
+  p += snprintf(p, size, FMT_WORD ":", pc);
+  int i;
+#ifdef CONFIG_ISA_x86
+  for (i = 0; i < len; i ++) {
+#else
+  for (i = len - 1; i >= 0; i --) {
+#endif
+    p += snprintf(p, 4, " %02x", inst[i]);
+  }
+  int ilen_max = MUXDEF(CONFIG_ISA_x86, 8, 4);
+  int space_len = ilen_max - len;
+  if (space_len < 0) space_len = 0;
+  space_len = space_len * 3 + 1;
+  memset(p, ' ', space_len);
+  p += space_len;
+
+  disassemble(p, buf + size - p, MUXDEF(CONFIG_ISA_x86, pc + len, pc), (uint8_t *)inst, len);
+}
+
+void itrace_dump() {
+  extern FILE *log_fp;
+  uint64_t nr = itrace_nr < CONFIG_ITRACE_SIZE ? itrace_nr : CONFIG_ITRACE_SIZE;
+  if (nr == 0) return;
+  char buf[128];
+  printf("Recently executed instructions:\n");
+  if (log_fp != NULL && log_fp != stdout) fprintf(log_fp, "Recently executed instructions:\n");
+  for (uint64_t k = itrace_nr - nr; k < itrace_nr; k ++) {
+    ItraceRecord *r = &itrace_buf[k & (CONFIG_ITRACE_SIZE - 1)];
+    itrace_format(buf, sizeof(buf), r->pc, r->inst, r->len);
+    const char *mark = (k == itrace_nr - 1 ? "-->" : "   ");
+    printf("%s %s\n", mark, buf);
+    if (log_fp != NULL && log_fp != stdout) fprintf(log_fp, "%s %s\n", mark, buf);
+  }
+  if (log_fp != NULL) fflush(log_fp);
+}
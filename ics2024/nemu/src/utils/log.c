@@ -30,8 +30,19 @@ void init_log(const char *log_file) {
   Log("Log is written to %s", log_file ? log_file : "stdout");
 }
 
+#ifdef CONFIG_TRACE
+static uint64_t trace_start = CONFIG_TRACE_START;
+static uint64_t trace_end = CONFIG_TRACE_END;
+
+// change the window of instructions to trace at runtime
+void log_set_window(uint64_t start, uint64_t end) {
+  trace_start = start;
+  trace_end = end;
+}
+#endif
+
 bool log_enable() {
-  return MUXDEF(CONFIG_TRACE, (g_nr_guest_inst >= CONFIG_TRACE_START) &&
-         (g_nr_guest_inst <= CONFIG_TRACE_END), false);
+  return MUXDEF(CONFIG_TRACE, (g_nr_guest_inst >= trace_start) &&
+         (g_nr_guest_inst <= trace_end), false);
 }
 #endif
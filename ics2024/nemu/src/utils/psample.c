@@ -0,0 +1,84 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <isa.h>
+
+#define STACK_MAX 256
+
+uint64_t psample_left = CONFIG_PC_SAMPLE_INTERVAL;
+static char *folded_file = NULL;
+
+// the caller of the outermost call, then the callees of the calls which
+// have not returned
+static vaddr_t stack[STACK_MAX + 1];
+static int depth = 0; // may exceed STACK_MAX, the deeper frames are dropped
+
+// sampled stacks with their frames joined by ';', counted in val[0]
+static HashTable folded = {};
+
+void psample_set_file(char *file) {
+  folded_file = file;
+}
+
+void psample_jump(vaddr_t pc, vaddr_t dnpc, int jump_kind) {
+  if (jump_kind == JUMP_CALL) {
+    if (depth == 0) stack[0] = pc;
+    if (depth < STACK_MAX) stack[depth + 1] = dnpc;
+    depth ++;
+  } else if (depth > 0) {
+    depth --;
+  }
+}
+
+static char *frame_name(vaddr_t addr, char *buf) {
+  int idx = elf_func_find(addr);
+  if (idx >= 0) return elf_func[idx].name;
+  sprintf(buf, FMT_WORD, addr);
+  return buf;
+}
+
+void psample_take(vaddr_t pc) {
+  psample_left = CONFIG_PC_SAMPLE_INTERVAL;
+  static char buf[STACK_MAX * 64];
+  char name[32];
+  char *p = buf, *end = buf + sizeof(buf);
+  int n = (depth == 0 ? 0 : (depth < STACK_MAX ? depth : STACK_MAX) + 1);
+  for (int i = 0; i < n && p < end; i ++) {
+    p += snprintf(p, end - p, "%s;", frame_name(stack[i], name));
+  }
+  if (p > end) p = end;
+  // the sampled pc is usually inside the innermost callee
+  int leaf = elf_func_find(pc);
+  if (n > 0 && leaf >= 0 && elf_func_find(stack[n - 1]) == leaf) { p[-1] = '\0'; }
+  else if (p < end) { snprintf(p, end - p, "%s", frame_name(pc, name)); }
+  hash_get(&folded, 0, buf)->val[0] ++;
+}
+
+void psample_report() {
+  if (folded_file == NULL || folded.nr == 0) return;
+  FILE *fp = fopen(folded_file, "w");
+  if (fp == NULL) { Log("Can not open '%s'", folded_file); return; }
+  uint64_t total = 0;
+  for (int i = 0; i < folded.size; i ++) {
+    HashEntry *e = &folded.entry[i];
+    if (!e->valid) continue;
+    fprintf(fp, "%s %" PRIu64 "\n", e->str, e->val[0]);
+    total += e->val[0];
+  }
+  fclose(fp);
+  Log("%" PRIu64 " samples of %d stacks are written to %s", total, folded.nr, folded_file);
+}
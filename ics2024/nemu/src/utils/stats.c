@@ -0,0 +1,82 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+
+extern uint64_t g_nr_guest_inst;
+extern uint64_t g_nr_guest_inst_base;
+extern uint64_t g_timer;
+extern FILE *log_fp;
+
+static char *stats_file = NULL;
+
+void stats_set_file(char *file) {
+  stats_file = file;
+}
+
+static const char *state_name() {
+  switch (nemu_state.state) {
+    case NEMU_RUNNING: return "running";
+    case NEMU_STOP: return "stop";
+    case NEMU_END: return "end";
+    case NEMU_ABORT: return "abort";
+    default: return "quit";
+  }
+}
+
+// write a JSON report of the run, for tools tracking the performance
+void stats_write() {
+  if (stats_file == NULL) return;
+  FILE *fp = fopen(stats_file, "w");
+  if (fp == NULL) { Log("Can not open '%s'", stats_file); return; }
+
+  uint64_t nr_inst = g_nr_guest_inst - g_nr_guest_inst_base;
+  fprintf(fp, "{\n  \"isa\": \"%s\",\n  \"engine\": \"%s\",\n", str(__GUEST_ISA__), CONFIG_ENGINE);
+  fprintf(fp, "  \"state\": \"%s\",\n  \"halt_ret\": %u,\n", state_name(), nemu_state.halt_ret);
+  fprintf(fp, "  \"host_time_us\": %" PRIu64 ",\n", g_timer);
+  fprintf(fp, "  \"guest_instructions\": %" PRIu64 ",\n", g_nr_guest_inst);
+  // the instructions restored from a checkpoint are not run by this process
+  fprintf(fp, "  \"instructions_run\": %" PRIu64 ",\n", nr_inst);
+  fprintf(fp, "  \"mips\": %.3f,\n", (g_timer > 0 ? (double)nr_inst / g_timer : 0.0));
+
+#ifdef CONFIG_DEVICE
+  extern uint64_t device_update_nr, device_update_time;
+  fprintf(fp, "  \"device_update\": { \"calls\": %" PRIu64 ", \"time_us\": %" PRIu64 " },\n",
+      device_update_nr, device_update_time);
+#endif
+#ifdef CONFIG_MODE_SYSTEM
+  void mmio_dump_stats(FILE *fp);
+  fprintf(fp, "  \"mmio\": ");
+  mmio_dump_stats(fp);
+  fprintf(fp, ",\n");
+#endif
+#ifdef CONFIG_HAS_PORT_IO
+  void pio_dump_stats(FILE *fp);
+  fprintf(fp, "  \"pio\": ");
+  pio_dump_stats(fp);
+  fprintf(fp, ",\n");
+#endif
+#ifdef CONFIG_DIFFTEST
+  extern uint64_t difftest_time;
+  fprintf(fp, "  \"difftest_time_us\": %" PRIu64 ",\n", difftest_time);
+#endif
+
+  long log_size = 0;
+  if (log_fp != NULL && log_fp != stdout) { fflush(log_fp); log_size = ftell(log_fp); }
+  fprintf(fp, "  \"trace\": { \"log_bytes\": %ld, \"itrace_records\": %" PRIu64 " }\n}\n",
+      (log_size > 0 ? log_size : 0), MUXDEF(CONFIG_ITRACE, itrace_nr, (uint64_t)0));
+  fclose(fp);
+}
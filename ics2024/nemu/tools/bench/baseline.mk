@@ -0,0 +1,2 @@
+# Baseline MIPS of `make bench`, one line per ISA, engine and workload.
+# They depend on the host, so regenerate them with `make bench-update`.
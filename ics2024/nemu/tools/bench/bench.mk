@@ -0,0 +1,77 @@
+#***************************************************************************************
+# Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+# `make bench` runs every workload BENCH_RUNS times in batch mode and takes the best
+# inst/s of the runs, since a slower run only shows the noise of the host. A workload
+# fails when it is more than BENCH_TOLERANCE percent below the baseline of this ISA
+# and engine, and `make bench-update` stores the current numbers as the baseline.
+BENCH_HOME = $(NEMU_HOME)/tools/bench
+BENCH_LIST ?= int mem branch mmio
+BENCH_RUNS ?= 3
+BENCH_TOLERANCE ?= 5
+BENCH_BASELINE ?= $(BENCH_HOME)/baseline.mk
+BENCH_DIR = $(BUILD_DIR)/bench
+BENCH_KEY = bench-baseline-$(GUEST_ISA)-$(ENGINE)
+BENCH_RESULT = $(addprefix $(BENCH_DIR)/,$(addsuffix .mips,$(BENCH_LIST)))
+
+-include $(BENCH_BASELINE)
+
+$(BENCH_DIR)/%.mips: $(BINARY) FORCE
+	@mkdir -p $(BENCH_DIR) && rm -f $@.runs
+	@$(MAKE) -s -C $(BENCH_HOME) BENCH=$* ARCH=$(GUEST_ISA)-nemu image
+	@for i in $$(seq $(BENCH_RUNS)); do \
+	  $(BINARY) -b -l /dev/null --stats=$(BENCH_DIR)/$*.json $(BENCH_HOME)/build/bench-$*-$(GUEST_ISA)-nemu.bin > /dev/null || \
+	    { echo "bench $*: NEMU did not hit GOOD TRAP"; exit 1; }; \
+	  sed -n 's/^  "mips": \(.*\),$$/\1/p' $(BENCH_DIR)/$*.json >> $@.runs; \
+	done
+	@sort -g $@.runs | tail -n 1 > $@
+
+# prototype: bench_check(workload), sets `fail` in the shell when it regresses
+# or has no baseline
+define bench_check
+awk -v name=$(1) -v base=$($(BENCH_KEY)-$(1)) -v tol=$(BENCH_TOLERANCE) '{ \
+  if (base == "") { printf "%-8s %10.3f %10s  NO BASELINE, see make bench-update\n", name, $$1, "-"; exit 1 } \
+  d = ($$1 - base) * 100 / base; \
+  printf "%-8s %10.3f %10.3f %+8.1f%%%s\n", name, $$1, base, d, (d < -tol ? "  REGRESSION" : ""); \
+  exit (d < -tol) }' $(BENCH_DIR)/$(1).mips || fail=1;
+endef
+
+bench: $(BENCH_RESULT)
+	@printf "%-8s %10s %10s %9s\n" workload MIPS baseline change
+	@fail=0; $(foreach b,$(BENCH_LIST),$(call bench_check,$(b))) \
+	  if [ $$fail -ne 0 ]; then echo "bench: slower than the baseline of $(BENCH_KEY) by more than $(BENCH_TOLERANCE)%, or no baseline"; exit 1; fi
+
+bench-update: $(BENCH_RESULT)
+	@touch $(BENCH_BASELINE)
+	@$(foreach b,$(BENCH_LIST),sed -i '/^$(BENCH_KEY)-$(b) /d' $(BENCH_BASELINE) && \
+	  echo "$(BENCH_KEY)-$(b) = $$(cat $(BENCH_DIR)/$(b).mips)" >> $(BENCH_BASELINE);)
+	@echo "bench: baseline of $(GUEST_ISA)-$(ENGINE) is written to $(BENCH_BASELINE)"
+
+# `make microbench` links the objects of NEMU, except the main(), with microbench.c
+MICROBENCH = $(BUILD_DIR)/$(NAME)-microbench
+MICROBENCH_OBJS = $(filter-out $(OBJ_DIR)/src/nemu-main.o,$(OBJS)) $(OBJ_DIR)/tools/bench/microbench.o
+
+-include $(OBJ_DIR)/tools/bench/microbench.d
+
+$(MICROBENCH): $(MICROBENCH_OBJS) $(ARCHIVES)
+	@echo + LD $@
+	@$(LD) -o $@ $(MICROBENCH_OBJS) $(LDFLAGS) $(ARCHIVES) $(LIBS)
+
+microbench: $(MICROBENCH)
+	@$(MICROBENCH)
+
+FORCE:
+
+.PHONY: bench bench-update microbench FORCE
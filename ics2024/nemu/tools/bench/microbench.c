@@ -0,0 +1,147 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+/* Host-side microbenchmarks of the hot paths of NEMU, linked with the objects
+ * of the configured build instead of nemu-main.c. Every case is timed over a
+ * fixed number of operations and reported in ns/op.
+ */
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/decode.h>
+#include <memory/paddr.h>
+#include <time.h>
+
+void init_log(const char *log_file);
+void init_mem();
+void init_device();
+word_t mmio_read(paddr_t addr, int len);
+
+static double now_ns() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+#define BENCH(name, n, body) do { \
+  double __start = now_ns(); \
+  for (uint64_t i = 0; i < (n); i ++) { body; } \
+  printf("%-28s %8.2f ns/op\n", name, (now_ns() - __start) / (n)); \
+} while (0)
+
+// keep the compiler from removing the work being timed
+static volatile word_t sink;
+
+#ifdef CONFIG_ISA_riscv
+#define NR_STREAM_INST 1024
+#define NR_EXEC (16 * 1024 * 1024)
+
+// an instruction stream repeating `inst`, restarted when its end is reached
+static void exec_stream(const char *name, paddr_t base, const uint32_t *inst, int nr_inst) {
+  for (int i = 0; i < NR_STREAM_INST; i ++) {
+    paddr_write(base + i * 4, 4, inst[i % nr_inst]);
+  }
+  vaddr_t end = base + NR_STREAM_INST * 4;
+
+  Decode s;
+  cpu.pc = base;
+  cpu.gpr[10] = base + 0x8000; // the data accessed by loads and stores
+  BENCH(name, NR_EXEC, s.pc = cpu.pc; s.snpc = cpu.pc; isa_exec_once(&s);
+      cpu.pc = (s.dnpc == end ? base : s.dnpc));
+  if (nemu_state.state == NEMU_ABORT) printf("  (aborted, the stream is not fully implemented)\n");
+  nemu_state.state = NEMU_STOP;
+}
+
+static void bench_exec() {
+  static const uint32_t alu[] = {
+    0x00000097, // auipc x1, 0
+  };
+  static const uint32_t mem[] = {
+    0x00054283, // lbu  x5, 0(x10)
+    0x005500a3, // sb   x5, 1(x10)
+  };
+  static const uint32_t csr[] = {
+    0xb00022f3, // csrrs x5, mcycle, x0
+  };
+  // every stream lives in its own page to keep them apart in the decode cache
+  exec_stream("isa_exec_once (alu)", RESET_VECTOR + 0x10000, alu, ARRLEN(alu));
+  exec_stream("isa_exec_once (load/store)", RESET_VECTOR + 0x20000, mem, ARRLEN(mem));
+  exec_stream("isa_exec_once (csr)", RESET_VECTOR + 0x30000, csr, ARRLEN(csr));
+}
+#endif
+
+#define NR_ACCESS (64 * 1024 * 1024)
+// walk 1MB of pmem, so the accesses hit the host caches, above the streams of bench_exec()
+#define PADDR_BASE (RESET_VECTOR + 0x100000)
+#define PADDR_OF(i, len) (PADDR_BASE + ((i) * (len) & 0xfffff))
+
+static void bench_paddr() {
+  static const int lens[] = { 1, 2, 4, IFDEF(CONFIG_ISA64, 8) };
+  char name[32];
+  for (int k = 0; k < ARRLEN(lens); k ++) {
+    int len = lens[k];
+    snprintf(name, sizeof(name), "paddr_read (len = %d)", len);
+    BENCH(name, NR_ACCESS, sink += paddr_read(PADDR_OF(i, len), len));
+    snprintf(name, sizeof(name), "paddr_write (len = %d)", len);
+    BENCH(name, NR_ACCESS, paddr_write(PADDR_OF(i, len), len, i));
+  }
+}
+
+#if defined(CONFIG_DEVICE) && defined(CONFIG_HAS_VGA)
+// the frame buffer has no callback, so only the dispatch of MMIO is timed
+static void bench_mmio() {
+  BENCH("mmio_read (vmem)", NR_ACCESS, sink += mmio_read(CONFIG_FB_ADDR + (i * 4 & 0xffff), 4));
+  BENCH("paddr_read (vmem)", NR_ACCESS, sink += paddr_read(CONFIG_FB_ADDR + (i * 4 & 0xffff), 4));
+  BENCH("paddr_write (vmem)", NR_ACCESS, paddr_write(CONFIG_FB_ADDR + (i * 4 & 0xffff), 4, i));
+}
+#endif
+
+#ifdef CONFIG_ISA_riscv
+// the patterns are read through a volatile pointer, so they are decoded at run time
+static const char *patterns[] = {
+  "??????? ????? ????? ??? ????? 01101 11",
+  "??????? ????? ????? 010 ????? 00000 11",
+  "0000000 ????? ????? 000 ????? 01100 11",
+  "??????? ????? ????? 001 ????? 11000 11",
+};
+#else
+static const char *patterns[] = { "???? ???? 0000 1111", "1100 1100 ???? ????" };
+#endif
+
+static void bench_decode() {
+  const char * volatile *p = patterns;
+  uint64_t key, mask, shift;
+  BENCH("pattern_decode", NR_ACCESS / 16, {
+    const char *str = p[i % ARRLEN(patterns)];
+    pattern_decode(str, strlen(str), &key, &mask, &shift);
+    sink += key ^ mask ^ shift;
+  });
+}
+
+int main(int argc, char *argv[]) {
+  init_log(NULL);
+  init_mem();
+  IFDEF(CONFIG_DEVICE, init_device());
+  init_isa();
+
+  IFDEF(CONFIG_ISA_riscv, bench_exec());
+  bench_paddr();
+#if defined(CONFIG_DEVICE) && defined(CONFIG_HAS_VGA)
+  bench_mmio();
+#endif
+  bench_decode();
+  return 0;
+}
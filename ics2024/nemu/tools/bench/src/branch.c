@@ -0,0 +1,37 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <am.h>
+#include <klib.h>
+
+// branchy code: data-dependent branches and a switch on random values
+#define N 2000000
+
+int main() {
+  uint32_t x = 0x9e3779b9, cnt[4] = {0};
+  for (int i = 0; i < N; i ++) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    switch (x & 7) {
+      case 0: cnt[0] ++; break;
+      case 1: case 2: cnt[1] += x & 1; break;
+      case 3: if (x & 0x100) cnt[2] ++; else cnt[3] ++; break;
+      default:
+        if ((x >> 8) & 1) cnt[0] += 2;
+        else if ((x >> 9) & 1) cnt[1] += 3;
+        break;
+    }
+  }
+  return cnt[0] + cnt[1] + cnt[2] + cnt[3] == 0 ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <am.h>
+#include <klib.h>
+
+// integer loops: arithmetic, logic and shifts on registers only
+#define N 4000000
+
+int main() {
+  uint32_t x = 1, y = 0x12345678, sum = 0;
+  for (int i = 0; i < N; i ++) {
+    x = x * 1103515245 + 12345;
+    y ^= y << 13; y ^= y >> 17; y ^= y << 5;
+    sum += (x >> 16) + (y & 0xff) - (i ^ x);
+  }
+  return sum == 0 ? 1 : 0;
+}
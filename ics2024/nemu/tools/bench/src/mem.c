@@ -0,0 +1,33 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <am.h>
+#include <klib.h>
+
+// memory streaming: copy and reduce over arrays larger than the host caches
+#define N (1024 * 1024)
+#define PASSES 4
+
+static uint32_t a[N], b[N];
+
+int main() {
+  uint32_t sum = 0;
+  for (int i = 0; i < N; i ++) a[i] = i;
+  for (int p = 0; p < PASSES; p ++) {
+    for (int i = 0; i < N; i ++) b[i] = a[i] + p;
+    for (int i = 0; i < N; i ++) sum += b[i];
+  }
+  return sum == 0 ? 1 : 0;
+}
@@ -0,0 +1,36 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <am.h>
+#include <klib.h>
+#include <nemu.h>
+
+// MMIO-heavy I/O: poll the timer and the screen size, fill the frame buffer and sync
+#define FRAMES 20
+
+int main() {
+  volatile uint32_t *fb = (volatile uint32_t *)FB_ADDR;
+  uint32_t sum = 0;
+  for (int f = 0; f < FRAMES; f ++) {
+    uint32_t wh = inl(VGACTL_ADDR);
+    int w = wh >> 16, h = wh & 0xffff;
+    for (int i = 0; i < w * h; i ++) {
+      fb[i] = i + f;
+      if ((i & 0x3f) == 0) sum += inl(RTC_ADDR);
+    }
+    outl(VGACTL_ADDR + 4, 1);
+  }
+  return sum == 0xffffffff ? 1 : 0;
+}
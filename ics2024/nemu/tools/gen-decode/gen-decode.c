@@ -0,0 +1,254 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+/* Generate decision trees for the INSTPAT patterns in a source file.
+ *
+ * For every INSTPAT_START() at line L, a function
+ *   static inline int instpat_tree_L(uint64_t inst);
+ * is emitted, which returns the line number of the first INSTPAT() in the
+ * block matching `inst', or 0 if none matches. The tree switches on the
+ * fixed bits of the patterns, so the order of the patterns is kept while
+ * the matching does not scan them one by one.
+ *
+ * A pattern under #if/#ifdef/#ifndef inside the block is returned under
+ * the same conditionals, falling through to the following patterns when
+ * it is compiled out. A use of INSTPAT() which can not be parsed is an
+ * error, since a pattern missing from the tree would never be matched.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+
+#define MAX_PAT   1024
+#define MAX_FIELD 8 // at most 2^MAX_FIELD cases in a switch
+#define MAX_COND  16
+
+typedef struct {
+  int line;
+  uint64_t key, mask;
+  char *cond;    // conditional directives the pattern is under, or NULL
+  int nr_cond;   // number of #endif to close them
+} Pattern;
+
+static Pattern pat[MAX_PAT];
+static int nr_pat = 0;
+static const char *file = NULL;
+
+// conditionals opened inside the current block, each with the directives seen so far
+static char *cond[MAX_COND];
+static int nr_cond = 0;
+
+static void error(int line, const char *msg) {
+  fprintf(stderr, "%s:%d: %s\n", file, line, msg);
+  exit(1);
+}
+
+// the same conversion as pattern_decode() in include/cpu/decode.h
+static void parse_pattern(const char *p, int line) {
+  if (nr_pat == MAX_PAT) error(line, "too many patterns");
+  uint64_t key = 0, mask = 0;
+  int len = 0;
+  for (; *p != '"'; p ++) {
+    if (*p == ' ') continue;
+    if (*p != '0' && *p != '1' && *p != '?') error(line, "invalid character in pattern string");
+    if (++ len > 64) error(line, "pattern too long");
+    key  = (key  << 1) | (*p == '1');
+    mask = (mask << 1) | (*p != '?');
+  }
+  p ++;
+  while (isspace(*p)) p ++;
+  if (*p != ',') error(line, "the pattern string must be a single literal");
+
+  char *c = NULL;
+  if (nr_cond > 0) {
+    size_t size = 1;
+    for (int k = 0; k < nr_cond; k ++) size += strlen(cond[k]);
+    c = malloc(size);
+    c[0] = '\0';
+    for (int k = 0; k < nr_cond; k ++) strcat(c, cond[k]);
+  }
+  pat[nr_pat ++] = (Pattern) { .line = line, .key = key, .mask = mask, .cond = c, .nr_cond = nr_cond };
+}
+
+// append the directive `p' to the conditional at the top
+static void add_cond(const char *p) {
+  char *c = cond[nr_cond - 1];
+  c = realloc(c, (c == NULL ? 0 : strlen(c)) + strlen(p) + 1);
+  if (cond[nr_cond - 1] == NULL) c[0] = '\0';
+  cond[nr_cond - 1] = strcat(c, p);
+}
+
+// keep track of the conditionals inside a block, return true if `p' is a directive
+static bool parse_directive(const char *p, int line) {
+  if (*p != '#') return false;
+  size_t len = strlen(p);
+  if (len >= 2 && p[len - 2] == '\\') error(line, "directives inside the block must fit in one line");
+  const char *d = p + 1;
+  while (*d == ' ' || *d == '\t') d ++;
+  if (strncmp(d, "if", 2) == 0) {
+    if (nr_cond == MAX_COND) error(line, "conditionals nested too deep");
+    cond[nr_cond ++] = NULL;
+    add_cond(p);
+  } else if (strncmp(d, "elif", 4) == 0 || strncmp(d, "else", 4) == 0) {
+    if (nr_cond == 0) error(line, "#elif or #else without #if inside the block");
+    add_cond(p);
+  } else if (strncmp(d, "endif", 5) == 0) {
+    if (nr_cond == 0) error(line, "#endif without #if inside the block");
+    free(cond[-- nr_cond]);
+  }
+  return true;
+}
+
+static void indent(int depth) {
+  printf("%*s", depth * 2 + 2, "");
+}
+
+// `cand' is the list of patterns which are not ruled out by the bits in `tested'
+static void gen_tree(int *cand, int nr, uint64_t tested, int depth) {
+  if (nr == 0) { indent(depth); printf("return 0;\n"); return; }
+
+  // the first candidate matches once all its fixed bits are tested
+  Pattern *first = &pat[cand[0]];
+  uint64_t todo = first->mask & ~tested;
+  if (todo == 0) {
+    if (first->cond == NULL) { indent(depth); printf("return %d;\n", first->line); return; }
+    // the following candidates are matched if the pattern is compiled out
+    printf("%s", first->cond);
+    indent(depth); printf("return %d;\n", first->line);
+    for (int k = 0; k < first->nr_cond; k ++) printf("#endif\n");
+    gen_tree(cand + 1, nr - 1, tested, depth);
+    return;
+  }
+
+  // Among the bits still to test for the first candidate, switch on the
+  // field of adjacent bits which is fixed by the most candidates.
+  int score[64] = {};
+  for (int b = 0; b < 64; b ++) {
+    for (int k = 0; k < nr; k ++) score[b] += (pat[cand[k]].mask >> b) & 1;
+  }
+  int best_lo = 0, best_len = 0, best_score = -1;
+  for (int lo = 0; lo < 64; lo ++) {
+    int s = 0;
+    for (int len = 1; len <= MAX_FIELD && lo + len <= 64 && ((todo >> (lo + len - 1)) & 1); len ++) {
+      s += score[lo + len - 1];
+      if (s > best_score) { best_lo = lo; best_len = len; best_score = s; }
+    }
+  }
+
+  int lo = best_lo, nr_val = 1 << best_len;
+  uint64_t fmask = (nr_val - 1);
+  int *child = malloc(sizeof(int) * nr * nr_val);
+  int *nr_child = calloc(nr_val, sizeof(int));
+  int *group = malloc(sizeof(int) * nr_val); // the first value with the same child list
+  for (int v = 0; v < nr_val; v ++) {
+    for (int k = 0; k < nr; k ++) {
+      Pattern *p = &pat[cand[k]];
+      uint64_t m = (p->mask >> lo) & fmask;
+      if ((((p->key >> lo) ^ v) & m) == 0) child[v * nr + nr_child[v] ++] = cand[k];
+    }
+    group[v] = v;
+    for (int u = 0; u < v; u ++) {
+      if (group[u] == u && nr_child[u] == nr_child[v] &&
+          memcmp(&child[u * nr], &child[v * nr], sizeof(int) * nr_child[v]) == 0) {
+        group[v] = u; break;
+      }
+    }
+  }
+
+  // the largest group becomes the default
+  int def = 0, def_size = 0;
+  for (int v = 0; v < nr_val; v ++) {
+    int size = 0;
+    for (int u = v; u < nr_val; u ++) size += (group[u] == v);
+    if (group[v] == v && size > def_size) { def = v; def_size = size; }
+  }
+
+  indent(depth);
+  printf("switch ((inst >> %d) & 0x%llx) {\n", lo, (unsigned long long)fmask);
+  for (int v = 0; v < nr_val; v ++) {
+    if (group[v] != v || v == def) continue;
+    for (int u = v; u < nr_val; u ++) {
+      if (group[u] == v) { indent(depth + 1); printf("case 0x%x:\n", u); }
+    }
+    gen_tree(&child[v * nr], nr_child[v], tested | (fmask << lo), depth + 2);
+  }
+  indent(depth + 1); printf("default:\n");
+  gen_tree(&child[def * nr], nr_child[def], tested | (fmask << lo), depth + 2);
+  indent(depth); printf("}\n");
+
+  free(child);
+  free(nr_child);
+  free(group);
+}
+
+static void gen_block(int start_line) {
+  int cand[MAX_PAT];
+  for (int k = 0; k < nr_pat; k ++) cand[k] = k;
+  printf("static inline int instpat_tree_%d(uint64_t inst) {\n", start_line);
+  gen_tree(cand, nr_pat, 0, 0);
+  printf("}\n\n");
+  for (int k = 0; k < nr_pat; k ++) free(pat[k].cond);
+  nr_pat = 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s inst.c\n", argv[0]);
+    return 1;
+  }
+  file = argv[1];
+  FILE *fp = fopen(file, "r");
+  if (fp == NULL) { perror(file); return 1; }
+
+  printf("// Generated by tools/gen-decode from %s. Do not edit.\n\n", file);
+  printf("#include <stdint.h>\n\n");
+
+  char buf[4096];
+  int line = 0, start_line = 0;
+  while (fgets(buf, sizeof(buf), fp) != NULL) {
+    line ++;
+    char *p = buf;
+    while (isspace(*p)) p ++;
+    if (start_line != 0 && parse_directive(p, line)) continue;
+    if (strncmp(p, "INSTPAT_START(", 14) == 0) {
+      if (start_line != 0) error(line, "nested INSTPAT_START()");
+      start_line = line;
+    } else if (strncmp(p, "INSTPAT_END(", 12) == 0) {
+      if (start_line == 0) error(line, "INSTPAT_END() without INSTPAT_START()");
+      if (nr_cond != 0) error(line, "#if without #endif inside the block");
+      gen_block(start_line);
+      start_line = 0;
+    } else if (strncmp(p, "INSTPAT(", 8) == 0) {
+      p += 8;
+      while (isspace(*p)) p ++;
+      // only the lines with a literal pattern string, not the macro definitions
+      if (start_line == 0) {
+        if (*p == '"') error(line, "INSTPAT() outside INSTPAT_START() and INSTPAT_END()");
+        continue;
+      }
+      if (*p != '"') error(line, "the pattern string must be on the same line as INSTPAT(");
+      parse_pattern(p + 1, line);
+    } else if (start_line != 0 && strncmp(p, "//", 2) != 0 && strstr(p, "INSTPAT(") != NULL) {
+      error(line, "INSTPAT() must start the line");
+    }
+  }
+  if (start_line != 0) error(start_line, "INSTPAT_START() without INSTPAT_END()");
+  fclose(fp);
+  return 0;
+}